@@ -0,0 +1,55 @@
+//
+//  Batch.cpp
+//  GameProject
+//
+//  Created by Orin Elmquist on 6/12/18.
+//  Copyright © 2018 Orin Elmquist. All rights reserved.
+//
+
+#include "Batch.hpp"
+#include "Trace.hpp"
+#include <chrono>
+
+BatchParams::BatchParams() : firstSeed(0), count(0), cave(false), dungeon(true), width(100), height(100), smoothPasses(5), activeSmoothing(false), threads(0), stats(false) { }
+
+double BatchStats::worldsPerSecond() const {
+    return seconds > 0 ? worlds / seconds : 0;
+}
+
+BatchStats buildBatch(const BatchParams &params, const BatchSink &sink) {
+    ThreadPool pool(params.threads);
+    std::vector<World> worlds(pool.size(), World(params.width, params.height));
+    std::vector<GenerationStats> generation(pool.size());
+    BatchStats stats;
+    
+    for (size_t i = 0; i < worlds.size(); i++) {
+        worlds[i].setSmoothing(params.smoothPasses, params.activeSmoothing);
+        if (params.stats)
+            worlds[i].collectStats(&generation[i]);
+    }
+    
+    auto start = std::chrono::steady_clock::now();
+    
+    pool.run(params.count, [&](size_t i, unsigned thread) {
+        TRACE_SCOPE("world");
+        World &w = worlds[thread];
+        uint64_t seed = params.firstSeed + i;
+        
+        w.seed(seed);
+        if (params.cave)
+            w.buildCave();
+        if (params.dungeon)
+            w.buildDungeon(params.rooms);
+        
+        if (sink)
+            sink(seed, w, thread);
+    });
+    
+    for (const GenerationStats &g : generation)
+        stats.generation += g;
+    
+    stats.worlds = params.count;
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    
+    return stats;
+}
@@ -0,0 +1,62 @@
+//
+//  Batch.hpp
+//  GameProject
+//
+//  Created by Orin Elmquist on 6/12/18.
+//  Copyright © 2018 Orin Elmquist. All rights reserved.
+//
+
+#ifndef Batch_hpp
+#define Batch_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <functional>
+#include "World.hpp"
+#include "ThreadPool.hpp"
+
+/*
+ Batch generation - builds one World per seed in [firstSeed, firstSeed + count) on a thread pool.
+ Each pool thread reuses a single World, so buffers are only allocated by the first worlds built.
+
+ BatchParams:
+     firstSeed, count - seed range
+     cave, dungeon - which builders to run, in that order, when both are set
+     width, height - map size
+     rooms - dungeon parameters
+     smoothPasses, activeSmoothing - cave smoothing, see World::setSmoothing
+     threads - pool size, 0 for one per hardware thread
+     stats - collect GenerationStats, merged over every world into BatchStats::generation
+
+ The sink is called from the worker thread right after each world is built, with the index of
+ that thread. It must be safe to call from several threads at once.
+ */
+
+struct BatchParams {
+    uint64_t firstSeed;
+    uint64_t count;
+    bool cave;
+    bool dungeon;
+    int width, height;
+    DungeonParams rooms;
+    int smoothPasses;
+    bool activeSmoothing;
+    unsigned threads;
+    bool stats;
+    
+    BatchParams();
+};
+
+struct BatchStats {
+    uint64_t worlds;
+    double seconds;
+    GenerationStats generation;
+    
+    double worldsPerSecond() const;
+};
+
+typedef std::function<void(uint64_t seed, const World &w, unsigned thread)> BatchSink;
+
+BatchStats buildBatch(const BatchParams &params, const BatchSink &sink);
+
+#endif /* Batch_hpp */
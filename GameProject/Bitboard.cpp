@@ -0,0 +1,356 @@
+//
+//  Bitboard.cpp
+//  GameProject
+//
+//  Created by Orin Elmquist on 6/12/18.
+//  Copyright © 2018 Orin Elmquist. All rights reserved.
+//
+
+#include "Bitboard.hpp"
+#include "Trace.hpp"
+#include <atomic>
+
+//Below one changed word in this many, smoothActive switches from whole passes to the active set
+const size_t ACTIVE_FRACTION = 8;
+
+/*
+ Constructor and storage
+ */
+
+Bitboard::Bitboard() : w(0), h(0), words(0), dirtyWords(0) { }
+
+Bitboard::Bitboard(int w, int h) : w(0), h(0), words(0), dirtyWords(0) {
+    resize(w, h);
+}
+
+void Bitboard::resize(int _w, int _h) {
+    w = _w;
+    h = _h;
+    words = (w + 63) / 64;
+    bits.assign((size_t)words * h, 0);
+}
+
+void Bitboard::swap(Bitboard &other) {
+    bits.swap(other.bits);
+    std::swap(w, other.w);
+    std::swap(h, other.h);
+    std::swap(words, other.words);
+}
+
+uint64_t *Bitboard::row(int y) {
+    return &bits[(size_t)y * words];
+}
+
+const uint64_t *Bitboard::row(int y) const {
+    return &bits[(size_t)y * words];
+}
+
+
+/*
+ Conversion to and from a tile map of the same dimensions
+ load  - bit is set where map == val
+ store - writes setVal for set bits, clearVal otherwise
+ */
+
+void Bitboard::load(const std::vector<uint8_t> &map, int val) {
+    load(map, val, 0, h);
+}
+
+void Bitboard::load(const std::vector<uint8_t> &map, int val, int y1, int y2) {
+    for (int y = y1; y < y2; y++) {
+        const uint8_t *m = &map[(size_t)y * w];
+        uint64_t *r = row(y);
+        for (int i = 0; i < words; i++) {
+            uint64_t word = 0;
+            int n = std::min(64, w - i * 64);
+            for (int b = 0; b < n; b++)
+                word |= (uint64_t)(m[i * 64 + b] == val) << b;
+            r[i] = word;
+        }
+    }
+}
+
+void Bitboard::store(std::vector<uint8_t> &map, int setVal, int clearVal) const {
+    store(map, setVal, clearVal, 0, h);
+}
+
+void Bitboard::store(std::vector<uint8_t> &map, int setVal, int clearVal, int y1, int y2) const {
+    for (int y = y1; y < y2; y++) {
+        uint8_t *m = &map[(size_t)y * w];
+        const uint64_t *r = row(y);
+        for (int x = 0; x < w; x++)
+            m[x] = (r[x >> 6] >> (x & 63)) & 1 ? setVal : clearVal;
+    }
+}
+
+bool Bitboard::get(int x, int y) const {
+    return (row(y)[x >> 6] >> (x & 63)) & 1;
+}
+
+void Bitboard::set(int x, int y, bool val) {
+    uint64_t bit = (uint64_t)1 << (x & 63);
+    if (val)
+        row(y)[x >> 6] |= bit;
+    else
+        row(y)[x >> 6] &= ~bit;
+}
+
+
+/*
+ Smoothing automaton, bit-sliced.
+ A cell is set when 5 or more of the 9 cells in its 3x3 block (itself included) are set.
+ Border rows and columns are copied unchanged, matching the tile loop in World::buildCave.
+
+ Each column of three is summed into a 2 bit count (s1, s0), then the left, center and
+ right column counts are added with full adders so the 4 bit total is formed for 64 cells at once.
+
+ smoothRows - writes rows [y1, y2) of the next generation of src into this board
+ smooth     - runs passes generations, swapping with temp instead of copying
+ */
+
+//Bits of word i that are inside the border columns
+uint64_t Bitboard::innerMask(int i) const {
+    uint64_t inner = ~(uint64_t)0;
+
+    if (i == 0)
+        inner &= ~(uint64_t)1;
+    if (i == words - 1)
+        inner &= ((w % 64) ? ((uint64_t)1 << (w % 64)) - 1 : ~(uint64_t)0) >> 1;
+    return inner;
+}
+
+void Bitboard::smoothRows(const Bitboard &src, int y1, int y2) {
+    smoothBand<false>(src, y1, y2, NULL, 0);
+}
+
+//smoothRows, with MARK also setting a bit in changed (stride words a row) for every word that
+//differs from src and returning how many did
+template <bool MARK>
+size_t Bitboard::smoothBand(const Bitboard &src, int y1, int y2, uint64_t *changed, int stride) {
+    size_t count = 0;
+
+    for (int y = y1; y < y2; y++) {
+        const uint64_t *c = src.row(y);
+        uint64_t *out = row(y);
+        uint64_t *d = MARK ? changed + (size_t)y * stride : NULL;
+        uint64_t diff = 0;
+
+        if (y == 0 || y == h - 1 || w < 3) {
+            if (MARK)
+                std::fill(d, d + stride, 0);
+            for (int i = 0; i < words; i++)
+                out[i] = c[i];
+            continue;
+        }
+
+        const uint64_t *n = src.row(y - 1);
+        const uint64_t *s = src.row(y + 1);
+        uint64_t p0 = 0, p1 = 0, c0, c1, n0 = 0, n1 = 0;
+
+        columnSum(n[0], c[0], s[0], c0, c1);
+
+        for (int i = 0; i < words; i++) {
+            if (i + 1 < words)
+                columnSum(n[i + 1], c[i + 1], s[i + 1], n0, n1);
+            else
+                n0 = n1 = 0;
+
+            uint64_t inner = innerMask(i);
+            uint64_t next = (nextWord(p0, p1, c0, c1, n0, n1) & inner) | (c[i] & ~inner);
+            out[i] = next;
+
+            //A bit per word, stored 64 words at a time
+            if (MARK) {
+                diff |= (uint64_t)(next != c[i]) << (i & 63);
+                if ((i & 63) == 63 || i == words - 1) {
+                    d[i >> 6] = diff;
+                    count += __builtin_popcountll(diff);
+                    diff = 0;
+                }
+            }
+
+            p0 = c0;
+            p1 = c1;
+            c0 = n0;
+            c1 = n1;
+        }
+    }
+
+    return count;
+}
+
+//Next generation of word i of row y alone, y must not be a border row
+uint64_t Bitboard::smoothWord(const Bitboard &src, int y, int i) const {
+    const uint64_t *n = src.row(y - 1), *c = src.row(y), *s = src.row(y + 1);
+    uint64_t p0 = 0, p1 = 0, c0, c1, n0 = 0, n1 = 0;
+
+    if (i > 0)
+        columnSum(n[i - 1], c[i - 1], s[i - 1], p0, p1);
+    columnSum(n[i], c[i], s[i], c0, c1);
+    if (i + 1 < words)
+        columnSum(n[i + 1], c[i + 1], s[i + 1], n0, n1);
+
+    uint64_t inner = innerMask(i);
+    return (nextWord(p0, p1, c0, c1, n0, n1) & inner) | (c[i] & ~inner);
+}
+
+void Bitboard::smooth(Bitboard &temp, int passes) {
+    if (temp.w != w || temp.h != h)
+        temp.resize(w, h);
+
+    for (int i = 0; i < passes; i++) {
+        temp.smoothRows(*this, 0, h);
+        swap(temp);
+    }
+}
+
+
+/*
+ Active set smoothing
+ Same result as smooth for the same number of passes. A word can only change if a word in its 3x3
+ block of words changed in the pass before, so once few words change a pass only recomputes those
+ blocks, and the automaton stops early at the first pass that changes nothing.
+
+ Changed words are kept as a second, much smaller board with one bit per word. The words to
+ recompute are that board dilated by one in every direction, found a 64 words at a time.
+ Only the words a pass wrote can differ between the board and temp after the swap, and each of
+ them is recomputed in the next pass, so the rest of temp never needs copying.
+
+ While more than one word in ACTIVE_FRACTION changes, whole passes are cheaper than walking the
+ active words, so those are run instead (with the pool, if there is one).
+
+ smoothActive - runs up to passes generations and returns how many it ran
+ */
+
+int Bitboard::smoothActive(Bitboard &temp, int passes) {
+    return settle(temp, passes, NULL);
+}
+
+int Bitboard::smoothActive(Bitboard &temp, int passes, ThreadPool &pool) {
+    return settle(temp, passes, &pool);
+}
+
+int Bitboard::settle(Bitboard &temp, int passes, ThreadPool *pool) {
+    size_t count = 0;
+    int run;
+
+    if (temp.w != w || temp.h != h)
+        temp.resize(w, h);
+
+    dirtyWords = (words + 63) / 64;
+    dirty.resize((size_t)dirtyWords * h);
+    dirtyNext.resize((size_t)dirtyWords * h);
+
+    for (run = 0; run < passes && (run == 0 || count > 0); run++) {
+        if (run == 0 || count * ACTIVE_FRACTION > bits.size()) {
+            count = step(temp, pool, true);
+        } else
+            count = activePass(temp);
+        swap(temp);
+    }
+
+    return run;
+}
+
+//Recomputes the words next to last pass's changes into temp, returns how many changed
+size_t Bitboard::activePass(Bitboard &temp) {
+    TRACE_SCOPE("Bitboard::activePass");
+    uint64_t lastValid = (words % 64) ? ((uint64_t)1 << (words % 64)) - 1 : ~(uint64_t)0;
+    size_t count = 0;
+
+    std::fill(dirtyNext.begin(), dirtyNext.end(), 0);
+
+    for (int y = 1; y < h - 1; y++) {
+        const uint64_t *n = &dirty[(size_t)(y - 1) * dirtyWords];
+        const uint64_t *c = n + dirtyWords, *s = c + dirtyWords;
+        uint64_t *changed = &dirtyNext[(size_t)y * dirtyWords];
+        uint64_t prev = 0, cur = n[0] | c[0] | s[0], next;
+
+        for (int j = 0; j < dirtyWords; j++) {
+            next = j + 1 < dirtyWords ? n[j + 1] | c[j + 1] | s[j + 1] : 0;
+
+            uint64_t act = cur | (cur << 1) | (prev >> 63) | (cur >> 1) | (next << 63);
+            if (j == dirtyWords - 1)
+                act &= lastValid;
+
+            while (act) {
+                int i = j * 64 + __builtin_ctzll(act);
+                uint64_t value = smoothWord(*this, y, i);
+                act &= act - 1;
+
+                temp.row(y)[i] = value;
+                if (value != row(y)[i]) {
+                    changed[j] |= (uint64_t)1 << (i & 63);
+                    count++;
+                }
+            }
+
+            prev = cur;
+            cur = next;
+        }
+    }
+
+    dirty.swap(dirtyNext);
+    return count;
+}
+
+
+/*
+ Parallel smoothing
+ The board is cut into horizontal bands. Each band reads its own rows plus a one row halo above
+ and below from the previous generation, which is never written during a pass, so bands need no
+ locking. pool.run returns only after every band is done, acting as the barrier between passes.
+ Every row is computed from the previous generation alone, so the result does not depend on the
+ band size or the thread count.
+ */
+
+int Bitboard::bandHeight(int h, ThreadPool &pool) {
+    int bands = (int)pool.size() * 4;
+    return std::max(16, (h + bands - 1) / bands);
+}
+
+void Bitboard::smooth(Bitboard &temp, int passes, ThreadPool &pool) {
+    if (temp.w != w || temp.h != h)
+        temp.resize(w, h);
+
+    for (int i = 0; i < passes; i++) {
+        step(temp, &pool, false);
+        swap(temp);
+    }
+}
+
+//Writes the next generation into temp, in bands when there is a pool. With mark, the words that
+//change are also marked in dirty and counted.
+size_t Bitboard::step(Bitboard &temp, ThreadPool *pool, bool mark) {
+    uint64_t *changed = mark ? &dirty[0] : NULL;
+
+    if (!pool)
+        return mark ? temp.smoothBand<true>(*this, 0, h, changed, dirtyWords) : temp.smoothBand<false>(*this, 0, h, NULL, 0);
+
+    int band = bandHeight(h, *pool);
+    std::atomic<size_t> count(0);
+
+    pool->run((h + band - 1) / band, [&](size_t b, unsigned) {
+        TRACE_SCOPE("Bitboard::smoothRows");
+        int y1 = (int)b * band, y2 = std::min(h, y1 + band);
+        if (mark)
+            count += temp.smoothBand<true>(*this, y1, y2, changed, dirtyWords);
+        else
+            temp.smoothBand<false>(*this, y1, y2, NULL, 0);
+    });
+
+    return count;
+}
+
+
+/*
+ Value retrevial
+ */
+
+int Bitboard::width() const {
+    return w;
+}
+
+int Bitboard::height() const {
+    return h;
+}
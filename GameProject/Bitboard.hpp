@@ -0,0 +1,104 @@
+//
+//  Bitboard.hpp
+//  GameProject
+//
+//  Created by Orin Elmquist on 6/12/18.
+//  Copyright © 2018 Orin Elmquist. All rights reserved.
+//
+
+#ifndef Bitboard_hpp
+#define Bitboard_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+#include <algorithm>
+#include "ThreadPool.hpp"
+
+/*
+ Bitboard - one bit per cell, rows padded to whole 64 bit words.
+ Used by the cave generator to run the smoothing automaton a word (64 cells) at a time.
+ */
+
+class Bitboard {
+public:
+    Bitboard();
+    Bitboard(int w, int h);
+
+    void resize(int w, int h);
+    void swap(Bitboard &other);
+
+    void load(const std::vector<uint8_t> &map, int val);
+    void load(const std::vector<uint8_t> &map, int val, int y1, int y2);
+    void store(std::vector<uint8_t> &map, int setVal, int clearVal) const;
+    void store(std::vector<uint8_t> &map, int setVal, int clearVal, int y1, int y2) const;
+
+    bool get(int x, int y) const;
+    void set(int x, int y, bool val);
+
+    void smoothRows(const Bitboard &src, int y1, int y2);
+    void smooth(Bitboard &temp, int passes);
+    void smooth(Bitboard &temp, int passes, ThreadPool &pool);
+    int smoothActive(Bitboard &temp, int passes);
+    int smoothActive(Bitboard &temp, int passes, ThreadPool &pool);
+
+    static int bandHeight(int h, ThreadPool &pool);
+    static void columnSum(uint64_t a, uint64_t b, uint64_t c, uint64_t &s0, uint64_t &s1);
+    static uint64_t nextWord(uint64_t p0, uint64_t p1, uint64_t c0, uint64_t c1, uint64_t n0, uint64_t n1);
+
+    int width() const;
+    int height() const;
+
+private:
+    std::vector<uint64_t> bits;
+    int w, h, words;
+
+    //smoothActive scratch, one bit per word of the words that changed in the last pass
+    std::vector<uint64_t> dirty, dirtyNext;
+    int dirtyWords;
+
+    uint64_t *row(int y);
+    const uint64_t *row(int y) const;
+    uint64_t innerMask(int i) const;
+    uint64_t smoothWord(const Bitboard &src, int y, int i) const;
+    template <bool MARK>
+    size_t smoothBand(const Bitboard &src, int y1, int y2, uint64_t *changed, int stride);
+    size_t step(Bitboard &temp, ThreadPool *pool, bool mark);
+    int settle(Bitboard &temp, int passes, ThreadPool *pool);
+    size_t activePass(Bitboard &temp);
+};
+
+/*
+ The smoothing kernel, shared with StaticWorld
+
+ columnSum - 2 bit sums of three rows, 64 columns at a time
+ nextWord - next generation of one word from the column sums of the words before, at and after it
+ */
+
+inline void Bitboard::columnSum(uint64_t a, uint64_t b, uint64_t c, uint64_t &s0, uint64_t &s1) {
+    s0 = a ^ b ^ c;
+    s1 = (a & b) | (c & (a ^ b));
+}
+
+inline uint64_t Bitboard::nextWord(uint64_t p0, uint64_t p1, uint64_t c0, uint64_t c1, uint64_t n0, uint64_t n1) {
+    //Column sums for the west and east neighbors of every bit
+    uint64_t l0 = (c0 << 1) | (p0 >> 63);
+    uint64_t l1 = (c1 << 1) | (p1 >> 63);
+    uint64_t r0 = (c0 >> 1) | (n0 << 63);
+    uint64_t r1 = (c1 >> 1) | (n1 << 63);
+
+    //total = t0 + 2 * (k0 + u0) + 4 * u1
+    uint64_t t0 = l0 ^ c0 ^ r0;
+    uint64_t k0 = (l0 & c0) | (r0 & (l0 ^ c0));
+    uint64_t u0 = l1 ^ c1 ^ r1;
+    uint64_t u1 = (l1 & c1) | (r1 & (l1 ^ c1));
+    uint64_t v0 = k0 ^ u0;
+    uint64_t v1 = k0 & u0;
+    uint64_t w0 = u1 ^ v1;
+    uint64_t w1 = u1 & v1;
+
+    //total >= 5
+    return w1 | (w0 & (v0 | t0));
+}
+
+#endif /* Bitboard_hpp */
@@ -0,0 +1,118 @@
+//
+//  ChunkWorld.cpp
+//  GameProject
+//
+//  Created by Orin Elmquist on 6/12/18.
+//  Copyright © 2018 Orin Elmquist. All rights reserved.
+//
+
+#include "ChunkWorld.hpp"
+
+//Random stream for chunk noise, separate from the World streams
+const uint64_t STREAM_CHUNK = 16;
+
+ChunkWorld::ChunkWorld(uint64_t seed, size_t capacity, int _percentWall, int _passes) : rng(seed), limit(std::max((size_t)1, capacity)), percentWall(_percentWall), passes(_passes), made(0) { }
+
+
+/*
+ Cache
+ Chunk keys pack the two chunk coordinates into 32 bits each. Noise is keyed on 32 bit world
+ coordinates, so the world repeats every 2^32 cells on each axis.
+ */
+
+uint64_t ChunkWorld::key(int64_t cx, int64_t cy) {
+    return ((uint64_t)(uint32_t)cx << 32) | (uint32_t)cy;
+}
+
+int64_t ChunkWorld::floorDiv(int64_t a, int64_t b) {
+    return a / b - (a % b != 0 && (a < 0) != (b < 0));
+}
+
+const Bitboard &ChunkWorld::chunk(int64_t cx, int64_t cy) {
+    auto found = lookup.find(key(cx, cy));
+    
+    //Hit, move to the front
+    if (found != lookup.end()) {
+        chunks.splice(chunks.begin(), chunks, found->second);
+        return found->second->walls;
+    }
+    
+    //Miss, reuse the least recently used chunk when full, its list node and its lookup node both
+    //move to the new key, so once the cache is full a miss does not allocate
+    if (chunks.size() >= limit) {
+        auto node = lookup.extract(key(chunks.back().cx, chunks.back().cy));
+        chunks.splice(chunks.begin(), chunks, std::prev(chunks.end()));
+        node.key() = key(cx, cy);
+        node.mapped() = chunks.begin();
+        lookup.insert(std::move(node));
+    } else {
+        chunks.push_front(Chunk());
+        lookup[key(cx, cy)] = chunks.begin();
+    }
+    
+    Chunk &c = chunks.front();
+    c.cx = cx;
+    c.cy = cy;
+    generate(c);
+    
+    return c.walls;
+}
+
+int ChunkWorld::get(int64_t x, int64_t y) {
+    int64_t cx = floorDiv(x, CHUNK_SIZE), cy = floorDiv(y, CHUNK_SIZE);
+    return chunk(cx, cy).get((int)(x - cx * CHUNK_SIZE), (int)(y - cy * CHUNK_SIZE)) ? WALL : FLOOR;
+}
+
+void ChunkWorld::setCapacity(size_t count) {
+    limit = std::max((size_t)1, count);
+    while (chunks.size() > limit) {
+        lookup.erase(key(chunks.back().cx, chunks.back().cy));
+        chunks.pop_back();
+    }
+}
+
+void ChunkWorld::setMemoryLimit(size_t bytes) {
+    size_t perChunk = sizeof(Chunk) + CHUNK_SIZE * ((CHUNK_SIZE + 63) / 64) * sizeof(uint64_t) + 4 * sizeof(void *);
+    setCapacity(bytes / perChunk);
+}
+
+size_t ChunkWorld::capacity() const {
+    return limit;
+}
+
+size_t ChunkWorld::cached() const {
+    return chunks.size();
+}
+
+uint64_t ChunkWorld::generated() const {
+    return made;
+}
+
+
+/*
+ generate:
+     Fills a board passes cells larger than the chunk on every side with world coordinate noise,
+     smooths it and keeps the middle. After k passes every cell at least k cells in from the
+     board edge has its exact value, so the kept cells are exact after all passes.
+ */
+
+void ChunkWorld::generate(Chunk &c) {
+    int size = CHUNK_SIZE + 2 * passes;
+    int64_t x0 = c.cx * CHUNK_SIZE - passes, y0 = c.cy * CHUNK_SIZE - passes;
+    
+    padded.resize(size, size);
+    for (int y = 0; y < size; y++)
+        for (int x = 0; x < size; x++) {
+            uint64_t counter = ((uint64_t)(uint32_t)(y0 + y) << 32) | (uint32_t)(x0 + x);
+            padded.set(x, y, rng.at(STREAM_CHUNK, counter, 100) <= percentWall);
+        }
+    
+    padded.smooth(paddedTemp, passes);
+    
+    c.walls.resize(CHUNK_SIZE, CHUNK_SIZE);
+    for (int y = 0; y < CHUNK_SIZE; y++)
+        for (int x = 0; x < CHUNK_SIZE; x++)
+            c.walls.set(x, y, padded.get(x + passes, y + passes));
+    
+    made++;
+}
@@ -0,0 +1,69 @@
+//
+//  ChunkWorld.hpp
+//  GameProject
+//
+//  Created by Orin Elmquist on 6/12/18.
+//  Copyright © 2018 Orin Elmquist. All rights reserved.
+//
+
+#ifndef ChunkWorld_hpp
+#define ChunkWorld_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <list>
+#include <unordered_map>
+#include "World.hpp"
+
+/*
+ ChunkWorld - unbounded cave world generated on demand in CHUNK_SIZE x CHUNK_SIZE chunks.
+
+ A chunk depends only on (seed, chunk x, chunk y). The starting noise for every cell comes from
+ its world coordinates, and each chunk is smoothed with a margin of one cell per pass around it,
+ which is exactly how far a pass can carry information. Cells along a chunk border therefore
+ match what one huge map would give, so seams between chunks agree.
+
+ Chunks live in an LRU cache of at most capacity chunks. When it is full the least recently
+ used chunk is evicted and its storage reused, list and lookup nodes included, so once the cache
+ has filled up a miss does not allocate and memory stays flat however far the player goes.
+ Unlike World::buildCave there is no border wall and no removal of unreachable caverns,
+ both need the whole map.
+
+ Not thread safe, each thread should use its own ChunkWorld.
+ */
+
+class ChunkWorld {
+public:
+    static const int CHUNK_SIZE = 64;
+    
+    ChunkWorld(uint64_t seed, size_t capacity = 256, int percentWall = 46, int passes = 5);
+    
+    int get(int64_t x, int64_t y);
+    const Bitboard &chunk(int64_t cx, int64_t cy);
+    
+    void setCapacity(size_t chunks);
+    void setMemoryLimit(size_t bytes);
+    size_t capacity() const;
+    size_t cached() const;
+    uint64_t generated() const;
+    
+private:
+    struct Chunk {
+        int64_t cx, cy;
+        Bitboard walls;
+    };
+    
+    std::list<Chunk> chunks;
+    std::unordered_map<uint64_t, std::list<Chunk>::iterator> lookup;
+    Bitboard padded, paddedTemp;
+    Random rng;
+    size_t limit;
+    int percentWall, passes;
+    uint64_t made;
+    
+    static uint64_t key(int64_t cx, int64_t cy);
+    static int64_t floorDiv(int64_t a, int64_t b);
+    void generate(Chunk &c);
+};
+
+#endif /* ChunkWorld_hpp */
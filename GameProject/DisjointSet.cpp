@@ -0,0 +1,68 @@
+//
+//  DisjointSet.cpp
+//  GameProject
+//
+//  Created by Orin Elmquist on 6/12/18.
+//  Copyright © 2018 Orin Elmquist. All rights reserved.
+//
+
+#include "DisjointSet.hpp"
+
+DisjointSet::DisjointSet(size_t size) : count(0) {
+    reset(size);
+}
+
+void DisjointSet::reset(size_t size) {
+    parent.resize(size);
+    rank.assign(size, 0);
+    for (size_t i = 0; i < size; i++)
+        parent[i] = i;
+    count = size;
+}
+
+size_t DisjointSet::find(size_t i) {
+    while (parent[i] != i) {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+/*
+ merge - joins the sets holding i and j, false if they were already one set
+ */
+
+bool DisjointSet::merge(size_t i, size_t j) {
+    size_t a = find(i);
+    size_t b = find(j);
+    
+    if (a == b)
+        return false;
+    
+    if (rank[a] > rank[b]) {
+        parent[b] = a;
+    } else {
+        parent[a] = b;
+        if (rank[a] == rank[b])
+            rank[b]++;
+    }
+    
+    count--;
+    return true;
+}
+
+bool DisjointSet::connected() const {
+    return count <= 1;
+}
+
+bool DisjointSet::connected(size_t first, size_t second) {
+    return find(first) == find(second);
+}
+
+size_t DisjointSet::sets() const {
+    return count;
+}
+
+size_t DisjointSet::size() const {
+    return parent.size();
+}
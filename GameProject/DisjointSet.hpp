@@ -0,0 +1,44 @@
+//
+//  DisjointSet.hpp
+//  GameProject
+//
+//  Created by Orin Elmquist on 6/12/18.
+//  Copyright © 2018 Orin Elmquist. All rights reserved.
+//
+
+#ifndef DisjointSet_hpp
+#define DisjointSet_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+
+/*
+ DisjointSet - union-find over 0..size-1 stored in flat parent and rank arrays.
+ find uses iterative path halving and merge unions by rank. The number of sets is kept up to
+ date, so connected() (everything in one set) is O(1). reset keeps the arrays' capacity, so a
+ set reused for same sized or smaller problems does not allocate.
+ */
+
+class DisjointSet {
+public:
+    DisjointSet(size_t size = 0);
+    
+    void reset(size_t size);
+    
+    size_t find(size_t i);
+    bool merge(size_t i, size_t j);
+    
+    bool connected() const;
+    bool connected(size_t first, size_t second);
+    
+    size_t sets() const;
+    size_t size() const;
+    
+private:
+    std::vector<size_t> parent;
+    std::vector<uint8_t> rank;
+    size_t count;
+};
+
+#endif /* DisjointSet_hpp */
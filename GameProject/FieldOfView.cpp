@@ -0,0 +1,240 @@
+//
+//  FieldOfView.cpp
+//  GameProject
+//
+//  Created by Orin Elmquist on 6/12/18.
+//  Copyright © 2018 Orin Elmquist. All rights reserved.
+//
+
+#include "FieldOfView.hpp"
+#include "Trace.hpp"
+
+//Octant transforms, column o maps (dx, dy) of octant 0 onto octant o
+static const int OCTANTS[4][8] = {
+    {1, 0, 0, -1, -1, 0, 0, 1},
+    {0, 1, -1, 0, 0, -1, 1, 0},
+    {0, 1, 1, 0, 0, -1, -1, 0},
+    {1, 0, 0, 1, -1, 0, 0, -1}
+};
+
+FieldOfView::FieldOfView() : tiles(NULL), width(0), height(0), words(0), x1(0), y1(0), x2(0), y2(0),
+                             world(NULL), version(0), lastX(-1), lastY(-1), lastRadius(-1) { }
+
+
+/*
+ Computing
+
+ compute:
+     Rebuilds the room grid when the World changes, then either keeps the last result or marks
+     the viewer's lit room, if any, and casts the eight octants around the viewer.
+
+ cast:
+     Recursive shadowcasting over one octant, rows outward from the viewer. start and end are
+     the slopes still in view, a run of walls narrows them and the part of the row before the run
+     is cast on its own with a recursive call.
+ */
+
+void FieldOfView::compute(const World &w, int x, int y, int radius) {
+    TRACE_SCOPE("FieldOfView::compute");
+    Room room;
+
+    if (world != &w || version != w.getVersion())
+        reset(w);
+    tiles = w.tiles();
+
+    if (x == lastX && y == lastY && radius == lastRadius)
+        return;
+
+    clear();
+    lastX = x;
+    lastY = y;
+    lastRadius = radius;
+
+    if (x < 0 || y < 0 || x >= width || y >= height || radius < 0)
+        return;
+
+    if (litRoom(x, y, radius, room) >= 0)
+        markRoom(room);
+
+    mark(x, y);
+    for (int o = 0; o < 8; o++)
+        cast(x, y, 1, 1.0, 0.0, radius, OCTANTS[0][o], OCTANTS[1][o], OCTANTS[2][o], OCTANTS[3][o]);
+}
+
+void FieldOfView::cast(int cx, int cy, int row, double start, double end, int radius, int xx, int xy, int yx, int yy) {
+    double newStart = 0;
+
+    if (start < end)
+        return;
+
+    for (int j = row; j <= radius; j++) {
+        int dy = -j;
+        bool blocked = false;
+
+        for (int dx = -j; dx <= 0; dx++) {
+            int x = cx + dx * xx + dy * xy, y = cy + dx * yx + dy * yy;
+            double left = (dx - 0.5) / (dy + 0.5), right = (dx + 0.5) / (dy - 0.5);
+
+            if (start < right)
+                continue;
+            if (end > left)
+                break;
+
+            //Off the map blocks sight like a wall
+            bool inside = x >= 0 && y >= 0 && x < width && y < height;
+            bool wall = !inside || tiles[(size_t)y * width + x] == WALL;
+
+            if (inside && dx * dx + dy * dy <= radius * radius)
+                mark(x, y);
+
+            if (blocked) {
+                if (wall) {
+                    newStart = right;
+                    continue;
+                }
+                blocked = false;
+                start = newStart;
+            } else if (wall && j < radius) {
+                blocked = true;
+                cast(cx, cy, j + 1, start, left, radius, xx, xy, yx, yy);
+                newStart = right;
+            }
+        }
+
+        if (blocked)
+            break;
+    }
+}
+
+
+/*
+ Lit rooms
+
+ litRoom - id of the room (x, y) is inside, when every corner is within radius, otherwise -1
+ markRoom - sets the room's rectangle, walls included, a word at a time
+ */
+
+int FieldOfView::litRoom(int x, int y, int radius, Room &room) const {
+    int id = -1;
+
+    grid.any(x, y, x, y, [&](const Room &r) {
+        int rx = r.coords().first, ry = r.coords().second;
+        int rw = r.dim().first, rh = r.dim().second;
+
+        if (x <= rx || x >= rx + rw || y <= ry || y >= ry + rh)
+            return false;
+
+        int dx = std::max(x - rx, rx + rw - x), dy = std::max(y - ry, ry + rh - y);
+        if (dx * dx + dy * dy > radius * radius)
+            return false;
+
+        room = r;
+        id = r.num();
+        return true;
+    });
+
+    return id;
+}
+
+void FieldOfView::markRoom(const Room &r) {
+    int rx1 = r.coords().first, rx2 = r.coords().first + r.dim().first;
+    int ry1 = r.coords().second, ry2 = r.coords().second + r.dim().second;
+    int a = rx1 >> 6, b = rx2 >> 6;
+    uint64_t first = ~(uint64_t)0 << (rx1 & 63);
+    uint64_t last = ~(uint64_t)0 >> (63 - (rx2 & 63));
+
+    for (int y = ry1; y <= ry2; y++) {
+        uint64_t *row = &bits[(size_t)y * words];
+        if (a == b)
+            row[a] |= first & last;
+        else {
+            row[a] |= first;
+            for (int i = a + 1; i < b; i++)
+                row[i] = ~(uint64_t)0;
+            row[b] |= last;
+        }
+    }
+
+    x1 = std::min(x1, rx1);
+    y1 = std::min(y1, ry1);
+    x2 = std::max(x2, rx2 + 1);
+    y2 = std::max(y2, ry2 + 1);
+}
+
+
+/*
+ The bitset
+
+ reset - sizes the bitset for a new map and indexes its rooms
+ clear - zeroes the words under the last result's bounding box
+ mark - sets one tile and grows the bounding box
+ */
+
+void FieldOfView::reset(const World &w) {
+    const std::vector<Room> &rooms = w.getRooms();
+    int maxSide = 1;
+
+    world = &w;
+    version = w.getVersion();
+    width = w.getWidth();
+    height = w.getHeight();
+    words = (width + 63) / 64;
+    bits.assign((size_t)words * height, 0);
+
+    x1 = width;
+    y1 = height;
+    x2 = y2 = 0;
+    lastX = lastY = lastRadius = -1;
+
+    for (const Room &r : rooms)
+        maxSide = std::max(maxSide, std::max(r.dim().first, r.dim().second));
+    grid.reset(width, height, maxSide + 2);
+    for (const Room &r : rooms)
+        grid.insert(r);
+}
+
+void FieldOfView::clear() {
+    if (x2 > x1)
+        for (int y = y1; y < y2; y++)
+            std::fill(&bits[(size_t)y * words + (x1 >> 6)], &bits[(size_t)y * words + ((x2 - 1) >> 6)] + 1, 0);
+
+    x1 = width;
+    y1 = height;
+    x2 = y2 = 0;
+}
+
+void FieldOfView::mark(int x, int y) {
+    bits[(size_t)y * words + (x >> 6)] |= (uint64_t)1 << (x & 63);
+    x1 = std::min(x1, x);
+    y1 = std::min(y1, y);
+    x2 = std::max(x2, x + 1);
+    y2 = std::max(y2, y + 1);
+}
+
+
+/*
+ Value retrevial
+ */
+
+bool FieldOfView::visible(int x, int y) const {
+    if (x < 0 || y < 0 || x >= width || y >= height)
+        return false;
+    return (bits[(size_t)y * words + (x >> 6)] >> (x & 63)) & 1;
+}
+
+size_t FieldOfView::count() const {
+    size_t n = 0;
+
+    for (int y = y1; y < y2; y++)
+        for (int i = x1 >> 6; x2 > x1 && i <= (x2 - 1) >> 6; i++)
+            n += __builtin_popcountll(bits[(size_t)y * words + i]);
+    return n;
+}
+
+int FieldOfView::getWidth() const {
+    return width;
+}
+
+int FieldOfView::getHeight() const {
+    return height;
+}
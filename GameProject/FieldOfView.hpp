@@ -0,0 +1,73 @@
+//
+//  FieldOfView.hpp
+//  GameProject
+//
+//  Created by Orin Elmquist on 6/12/18.
+//  Copyright © 2018 Orin Elmquist. All rights reserved.
+//
+
+#ifndef FieldOfView_hpp
+#define FieldOfView_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+#include "World.hpp"
+
+/*
+ FieldOfView - the tiles visible from one point, by recursive shadowcasting.
+
+ WALL tiles block sight and are visible themselves, FLOOR and DOOR tiles are see-through. Tiles
+ further than radius (Euclidean) are not visible. The result is a bitset of the map, one row of
+ 64 bit words per map row, reused from call to call. Only the rectangle the last result touched
+ is cleared, so a query costs about its radius squared however big the map is.
+
+ A viewer inside one of buildDungeon's rooms is in a lit room, as in Rogue: the whole room, walls
+ and doors included, is visible. Rooms are open rectangles, so this is a few word masks per row.
+ It needs the radius to reach every corner of the room, otherwise the room is only what the cast
+ sees. Either way the viewer is cast from as well, so the halls past the doorways are seen the
+ same as from anywhere else and a larger radius never hides a tile.
+
+ compute - visibility from (x, y), a repeated query from the same point keeps the last result,
+           until World::getVersion changes
+ visible - whether (x, y) was visible in the last compute
+ count - number of visible tiles
+ */
+
+class FieldOfView {
+public:
+    FieldOfView();
+
+    void compute(const World &w, int x, int y, int radius);
+
+    bool visible(int x, int y) const;
+    size_t count() const;
+
+    int getWidth() const;
+    int getHeight() const;
+
+private:
+    std::vector<uint64_t> bits;
+    const Tile *tiles;
+    int width, height, words;
+
+    //Bounding box of the set bits, x2 and y2 exclusive
+    int x1, y1, x2, y2;
+
+    //Layout the rooms were taken from
+    const World *world;
+    uint64_t version;
+    RoomGrid grid;
+
+    //What the current bits hold
+    int lastX, lastY, lastRadius;
+
+    void reset(const World &w);
+    void clear();
+    int litRoom(int x, int y, int radius, Room &room) const;
+    void markRoom(const Room &r);
+    void mark(int x, int y);
+    void cast(int cx, int cy, int row, double start, double end, int radius, int xx, int xy, int yx, int yy);
+};
+
+#endif /* FieldOfView_hpp */
@@ -0,0 +1,174 @@
+//
+//  FlowField.cpp
+//  GameProject
+//
+//  Created by Orin Elmquist on 6/12/18.
+//  Copyright © 2018 Orin Elmquist. All rights reserved.
+//
+
+#include "FlowField.hpp"
+#include "Trace.hpp"
+
+//Starting base, leaves room for about a billion steps of retargeting before a rebuild
+const uint32_t START_BASE = 1u << 30;
+
+FlowField::FlowField() : base(START_BASE), width(0), height(0), stride(2), targets(0) { }
+
+
+/*
+ Building
+ 
+ reset:
+     Clears the targets. Open tiles start out at UINT32_MAX (not reached yet), walls and the
+     border at 0, which no step can improve on, so they are never entered.
+ 
+ propagate:
+     Breadth first from the first tail queued cells. A neighbor is taken whenever one more step
+     beats its stored value, cells come off the queue in distance order so each is queued once.
+ */
+
+void FlowField::build(const TileMap &w, int tx, int ty) {
+    TRACE_SCOPE("FlowField::build");
+    size_t tail = 0;
+    
+    reset(w);
+    addTarget(tx, ty, tail);
+    propagate(tail);
+}
+
+void FlowField::build(const TileMap &w, const std::vector<std::pair<int, int>> &t) {
+    TRACE_SCOPE("FlowField::build");
+    size_t tail = 0;
+    
+    reset(w);
+    for (const std::pair<int, int> &p : t)
+        addTarget(p.first, p.second, tail);
+    propagate(tail);
+}
+
+//Queues an open tile as a distance 0 cell, walls, repeats and tiles off the map are skipped
+void FlowField::addTarget(int x, int y, size_t &tail) {
+    if (x < 0 || y < 0 || x >= width || y >= height)
+        return;
+    
+    size_t i = index(x, y);
+    if (dist[i] == 0 || dist[i] == base)
+        return;
+    
+    dist[i] = base;
+    queue[tail++] = (uint32_t)i;
+    targets++;
+}
+
+void FlowField::reset(const TileMap &w) {
+    const Tile *tiles = w.tiles();
+    
+    width = w.getWidth();
+    height = w.getHeight();
+    stride = width + 2;
+    base = START_BASE;
+    targets = 0;
+    dist.resize((size_t)stride * (height + 2));
+    
+    //Every open cell is queued at most once, so the queue never grows during a search
+    if (queue.size() < (size_t)width * height + 1)
+        queue.resize((size_t)width * height + 1);
+    
+    std::fill(dist.begin(), dist.begin() + stride, 0);
+    std::fill(dist.end() - stride, dist.end(), 0);
+    
+    for (int y = 0; y < height; y++) {
+        const Tile *row = tiles + (size_t)y * width;
+        uint32_t *out = &dist[index(0, y)];
+        
+        out[-1] = 0;
+        for (int x = 0; x < width; x++)
+            out[x] = row[x] == FLOOR || row[x] == DOOR ? UINT32_MAX : 0;
+        out[width] = 0;
+    }
+}
+
+void FlowField::propagate(size_t tail) {
+    const ptrdiff_t step[4] = {-stride, 1, stride, -1};
+    uint32_t *d = dist.data();
+    uint32_t *q = queue.data();
+    
+    for (size_t head = 0; head < tail; head++) {
+        uint32_t i = q[head];
+        uint32_t next = d[i] + 1;
+        
+        for (ptrdiff_t s : step)
+            if (d[i + s] > next) {
+                d[i + s] = next;
+                q[tail++] = (uint32_t)(i + s);
+            }
+    }
+}
+
+
+/*
+ retarget:
+     Moving the only target from p to q changes the distance to any tile x by at most
+     k = dist(p, q), which the field already holds at q. So old distance + k is an upper bound
+     on the new one everywhere. Lowering base by k adds k to every stored distance at once,
+     then a search from q only has to visit the tiles whose distance actually went down.
+     Tiles behind the old target, relative to the move, are never touched.
+ 
+     Falls back to build after a multi target build, when q is a wall or not reachable from p
+     (the reachable area changes), or once base runs low.
+ */
+
+void FlowField::retarget(const TileMap &w, int tx, int ty) {
+    TRACE_SCOPE("FlowField::retarget");
+    uint32_t k = distance(tx, ty);
+    
+    if (targets != 1 || width != w.getWidth() || height != w.getHeight() || k == UNREACHABLE || k >= base) {
+        build(w, tx, ty);
+        return;
+    }
+    if (k == 0)
+        return;
+    
+    base -= k;
+    dist[index(tx, ty)] = base;
+    queue[0] = (uint32_t)index(tx, ty);
+    propagate(1);
+}
+
+
+/*
+ Lookups
+ */
+
+size_t FlowField::index(int x, int y) const {
+    return (size_t)(y + 1) * stride + x + 1;
+}
+
+uint32_t FlowField::distance(int x, int y) const {
+    if (x < 0 || y < 0 || x >= width || y >= height)
+        return UNREACHABLE;
+    
+    uint32_t v = dist[index(x, y)];
+    return v == UINT32_MAX || v < base ? UNREACHABLE : v - base;
+}
+
+int FlowField::direction(int x, int y) const {
+    if (distance(x, y) == UNREACHABLE || distance(x, y) == 0)
+        return -1;
+    
+    const ptrdiff_t step[4] = {-stride, 1, stride, -1};
+    size_t i = index(x, y);
+    
+    for (int dir = NORTH; dir <= WEST; dir++)
+        if (dist[i + step[dir]] == dist[i] - 1)
+            return dir;
+    return -1;
+}
+
+int FlowField::getWidth() const {
+    return width;
+}
+
+int FlowField::getHeight() const {
+    return height;
+}
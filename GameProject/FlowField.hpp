@@ -0,0 +1,63 @@
+//
+//  FlowField.hpp
+//  GameProject
+//
+//  Created by Orin Elmquist on 6/12/18.
+//  Copyright © 2018 Orin Elmquist. All rights reserved.
+//
+
+#ifndef FlowField_hpp
+#define FlowField_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+#include "World.hpp"
+
+/*
+ FlowField - distance from every open (FLOOR or DOOR) tile to the nearest target, in 4-connected
+ steps. Any number of entities can follow it toward the targets with one lookup per step.
+ 
+ Distances live in one flat row-major array with a one cell border, walls and the border hold 0
+ so the search needs no bounds checks. A value is stored as distance + base rather than the
+ distance itself, which is what lets retarget leave most of the array untouched (see retarget).
+ 
+ build - distances to one or many targets, a full breadth first search
+ retarget - moves a single target, exact, and cheaper than build when the move is short
+ distance - steps to the nearest target, UNREACHABLE for walls and cut off tiles
+ direction - NORTH, EAST, SOUTH or WEST toward a nearest target, -1 at a target or when unreachable
+ 
+ The field is a snapshot of the map, build again after the map changes. Any TileMap works, a
+ World, a StaticWorld or a MappedWorld.
+ */
+
+class FlowField {
+public:
+    static const uint32_t UNREACHABLE = UINT32_MAX;
+    
+    FlowField();
+    
+    void build(const TileMap &w, int tx, int ty);
+    void build(const TileMap &w, const std::vector<std::pair<int, int>> &targets);
+    void retarget(const TileMap &w, int tx, int ty);
+    
+    uint32_t distance(int x, int y) const;
+    int direction(int x, int y) const;
+    
+    int getWidth() const;
+    int getHeight() const;
+    
+private:
+    std::vector<uint32_t> dist;
+    std::vector<uint32_t> queue;
+    uint32_t base;
+    int width, height, stride;
+    int targets;
+    
+    size_t index(int x, int y) const;
+    void reset(const TileMap &w);
+    void addTarget(int x, int y, size_t &tail);
+    void propagate(size_t tail);
+};
+
+#endif /* FlowField_hpp */
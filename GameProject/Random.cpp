@@ -0,0 +1,116 @@
+//
+//  Random.cpp
+//  GameProject
+//
+//  Created by Orin Elmquist on 6/12/18.
+//  Copyright © 2018 Orin Elmquist. All rights reserved.
+//
+
+#include "Random.hpp"
+
+/*
+ Seeding, the sequential state is filled from the seed with splitmix64
+ */
+
+static uint64_t splitmix(uint64_t &x) {
+    uint64_t z = (x += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+Random::Random(uint64_t seed) {
+    this->seed(seed);
+}
+
+void Random::seed(uint64_t seed) {
+    uint64_t x = seed;
+    key = seed;
+    for (int i = 0; i < 4; i++)
+        s[i] = splitmix(x);
+}
+
+uint64_t Random::getSeed() const {
+    return key;
+}
+
+
+/*
+ Sequential stream, xoshiro256**
+ */
+
+static inline uint64_t rotl(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+uint64_t Random::next() {
+    uint64_t result = rotl(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+    
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl(s[3], 45);
+    
+    return result;
+}
+
+int Random::next(int n) {
+    return range((uint32_t)(next() >> 32), n);
+}
+
+
+/*
+ Counter based stream, Philox4x32-10
+ The 64 bit seed is the key, the counter and stream fill the 128 bit block.
+ */
+
+static inline void mulhilo(uint32_t a, uint32_t b, uint32_t &hi, uint32_t &lo) {
+    uint64_t p = (uint64_t)a * b;
+    hi = (uint32_t)(p >> 32);
+    lo = (uint32_t)p;
+}
+
+void Random::block(uint64_t stream, uint64_t counter, uint32_t out[4]) const {
+    uint32_t c0 = (uint32_t)counter, c1 = (uint32_t)(counter >> 32);
+    uint32_t c2 = (uint32_t)stream, c3 = (uint32_t)(stream >> 32);
+    uint32_t k0 = (uint32_t)key, k1 = (uint32_t)(key >> 32);
+    uint32_t hi0, lo0, hi1, lo1;
+    
+    for (int round = 0; round < 10; round++) {
+        mulhilo(0xD2511F53, c0, hi0, lo0);
+        mulhilo(0xCD9E8D57, c2, hi1, lo1);
+        c0 = hi1 ^ c1 ^ k0;
+        c1 = lo1;
+        c2 = hi0 ^ c3 ^ k1;
+        c3 = lo0;
+        k0 += 0x9E3779B9;
+        k1 += 0xBB67AE85;
+    }
+    
+    out[0] = c0;
+    out[1] = c1;
+    out[2] = c2;
+    out[3] = c3;
+}
+
+uint32_t Random::at(uint64_t stream, uint64_t counter) const {
+    uint32_t out[4];
+    block(stream, counter, out);
+    return out[0];
+}
+
+int Random::at(uint64_t stream, uint64_t counter, int n) const {
+    return range(at(stream, counter), n);
+}
+
+
+/*
+ range - maps a 32 bit value onto [0, n) with a multiply instead of a modulo
+ */
+
+int Random::range(uint32_t r, int n) {
+    return (int)(((uint64_t)r * (uint32_t)n) >> 32);
+}
@@ -0,0 +1,45 @@
+//
+//  Random.hpp
+//  GameProject
+//
+//  Created by Orin Elmquist on 6/12/18.
+//  Copyright © 2018 Orin Elmquist. All rights reserved.
+//
+
+#ifndef Random_hpp
+#define Random_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+
+/*
+ Random - seedable generator owned by a World, replaces the global rand()/srand() pair.
+
+ next()            - sequential xoshiro256** stream, for decisions that happen in order
+ at(stream, i)     - counter based Philox4x32-10, the value for (seed, stream, i) can be computed
+                     on its own, so parallel passes match serial ones
+ block(stream, i)  - all four 32 bit Philox outputs for (seed, stream, i)
+ */
+
+class Random {
+public:
+    Random(uint64_t seed = 0);
+    
+    void seed(uint64_t s);
+    uint64_t getSeed() const;
+    
+    uint64_t next();
+    int next(int n);
+    
+    uint32_t at(uint64_t stream, uint64_t counter) const;
+    int at(uint64_t stream, uint64_t counter, int n) const;
+    void block(uint64_t stream, uint64_t counter, uint32_t out[4]) const;
+    
+    static int range(uint32_t r, int n);
+    
+private:
+    uint64_t s[4];
+    uint64_t key;
+};
+
+#endif /* Random_hpp */
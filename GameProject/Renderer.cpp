@@ -0,0 +1,194 @@
+//
+//  Renderer.cpp
+//  GameProject
+//
+//  Created by Orin Elmquist on 6/12/18.
+//  Copyright © 2018 Orin Elmquist. All rights reserved.
+//
+
+#include "Renderer.hpp"
+#include <string.h>
+
+/*
+ Constructor - fills the lookup tables, the last entry is for unknown tile values
+ */
+
+Renderer::Renderer(Mode m) : mode(m), used(0), glyph{' ', '#', 'D', '?'}, grey{(char)255, 0, (char)128, 64} { }
+
+/*
+ Lookup - picks a table entry per tile, eight tiles per 64 bit word.
+ Bit 0 of a tile marks WALL and bit 1 marks DOOR, each is spread to a full byte mask and used
+ to blend the broadcast entries. Words holding any tile above DOOR take the per tile path.
+ Every step is byte-wise, so the result does not depend on byte order.
+ */
+
+const uint64_t ONES = 0x0101010101010101ULL;
+const uint64_t HIGH = 0x8080808080808080ULL;
+
+struct Lookup {
+    char floor, wall, door, other;
+    uint64_t floor8, wall8, door8;
+    
+    Lookup(const char *table) : floor(table[0]), wall(table[1]), door(table[2]), other(table[3]),
+        floor8(ONES * (uint8_t)floor), wall8(ONES * (uint8_t)wall), door8(ONES * (uint8_t)door) { }
+    
+    char operator()(Tile t) const {
+        return t == FLOOR ? floor : t == WALL ? wall : t == DOOR ? door : other;
+    }
+    
+    void row(char *out, const Tile *tiles, size_t n) const {
+        uint64_t t, isWall, isDoor, g;
+        size_t i = 0;
+        
+        for (; i + 8 <= n; i += 8) {
+            memcpy(&t, tiles + i, 8);
+            
+            //Some byte is 3 or more
+            if ((t | (t + (HIGH - 3 * ONES))) & HIGH) {
+                for (size_t j = i; j < i + 8; j++)
+                    out[j] = (*this)(tiles[j]);
+                continue;
+            }
+            
+            isWall = (t & ONES) * 0xFF;
+            isDoor = ((t >> 1) & ONES) * 0xFF;
+            g = (floor8 & ~(isWall | isDoor)) | (wall8 & isWall) | (door8 & isDoor);
+            memcpy(out + i, &g, 8);
+        }
+        
+        for (; i < n; i++)
+            out[i] = (*this)(tiles[i]);
+    }
+};
+
+//Length of the run of equal tiles starting at row[x], compared 8 tiles at a time.
+//On little endian targets the first differing tile is the lowest set byte of the xor.
+static int runLength(const Tile *row, int x, int width) {
+    uint64_t pattern = ONES * row[x], w;
+    int end = x + 1;
+    
+    while (end + 8 <= width) {
+        memcpy(&w, row + end, 8);
+        if (w != pattern) {
+#if defined(__GNUC__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+            return end + __builtin_ctzll(w ^ pattern) / 8 - x;
+#else
+            break;
+#endif
+        }
+        end += 8;
+    }
+    while (end < width && row[end] == row[x])
+        end++;
+    return end - x;
+}
+
+void Renderer::setMode(Mode m) {
+    mode = m;
+}
+
+Renderer::Mode Renderer::getMode() const {
+    return mode;
+}
+
+
+/*
+ render:
+     Replaces the buffer contents with the grid in the current mode.
+     ASCII and RLE both need at most width + 1 bytes a row, a run of n > 1 tiles takes at most
+     n bytes, so one bound covers both. PGM adds its header.
+ */
+
+void Renderer::render(const Tile *tiles, int width, int height) {
+    size_t need = (size_t)height * (width + 1) + 64;
+    char *end;
+    
+    if (buffer.size() < need)
+        buffer.resize(need);
+    
+    switch (mode) {
+        case RLE:
+            end = renderRLE(buffer.data(), tiles, width, height);
+            break;
+            
+        case PGM:
+            end = renderPGM(buffer.data(), tiles, width, height);
+            break;
+            
+        default:
+            end = renderASCII(buffer.data(), tiles, width, height);
+            break;
+    }
+    
+    used = end - buffer.data();
+}
+
+void Renderer::render(const TileMap &map) {
+    render(map.tiles(), map.getWidth(), map.getHeight());
+}
+
+char *Renderer::renderASCII(char *out, const Tile *tiles, int width, int height) const {
+    const Lookup lookup(glyph);
+    
+    for (int y = 0; y < height; y++) {
+        lookup.row(out, tiles + (size_t)y * width, width);
+        out += width;
+        *out++ = '\n';
+    }
+    return out;
+}
+
+char *Renderer::renderRLE(char *out, const Tile *tiles, int width, int height) const {
+    const Lookup lookup(glyph);
+    char digits[12];
+    int run, n, v;
+    
+    for (int y = 0; y < height; y++) {
+        const Tile *row = tiles + (size_t)y * width;
+        
+        for (int x = 0; x < width; x += run) {
+            run = runLength(row, x, width);
+            
+            //Count digits come out backwards, most significant first once copied
+            if (run > 1) {
+                for (n = 0, v = run; v > 0; v /= 10)
+                    digits[n++] = '0' + v % 10;
+                while (n > 0)
+                    *out++ = digits[--n];
+            }
+            *out++ = lookup(row[x]);
+        }
+        *out++ = '\n';
+    }
+    return out;
+}
+
+char *Renderer::renderPGM(char *out, const Tile *tiles, int width, int height) const {
+    const Lookup lookup(grey);
+    size_t cells = (size_t)width * height;
+    
+    out += sprintf(out, "P5\n%d %d\n255\n", width, height);
+    lookup.row(out, tiles, cells);
+    return out + cells;
+}
+
+
+/*
+ Output, one write for the whole buffer
+ */
+
+const char *Renderer::data() const {
+    return buffer.data();
+}
+
+size_t Renderer::size() const {
+    return used;
+}
+
+void Renderer::write(std::ostream &out) const {
+    out.write(buffer.data(), used);
+}
+
+bool Renderer::write(FILE *file) const {
+    return fwrite(buffer.data(), 1, used, file) == used;
+}
@@ -0,0 +1,66 @@
+//
+//  Renderer.hpp
+//  GameProject
+//
+//  Created by Orin Elmquist on 6/12/18.
+//  Copyright © 2018 Orin Elmquist. All rights reserved.
+//
+
+#ifndef Renderer_hpp
+#define Renderer_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <iostream>
+#include <vector>
+#include "World.hpp"
+#include "WorldFile.hpp"
+
+/*
+ Renderer - turns a tile grid into text or an image in one buffer, written out with one call.
+ Tiles go through small lookup tables (FLOOR, WALL, DOOR, anything else). The entry is picked
+ with compares rather than an indexed load so the compiler can vectorize the row loops.
+ The buffer is sized for the worst case up front and kept between renders.
+ 
+ Modes:
+     ASCII - one glyph per tile, ' ' FLOOR, '#' WALL, 'D' DOOR, '\n' after each row.
+             Same text as operator<<.
+     RLE   - each row as runs of <count><glyph>, the count is left out for runs of one.
+             Counts are digits, which no glyph uses, so "12#3 D\n" is 12 walls, 3 floors, a door.
+     PGM   - binary greymap (P5), FLOOR white, WALL black, DOOR grey.
+ */
+
+class Renderer {
+public:
+    enum Mode {
+        ASCII,
+        RLE,
+        PGM
+    };
+    
+    Renderer(Mode mode = ASCII);
+    
+    void setMode(Mode m);
+    Mode getMode() const;
+    
+    void render(const Tile *tiles, int width, int height);
+    void render(const TileMap &map);
+    
+    const char *data() const;
+    size_t size() const;
+    void write(std::ostream &out) const;
+    bool write(FILE *file) const;
+    
+private:
+    Mode mode;
+    std::vector<char> buffer;
+    size_t used;
+    char glyph[4];
+    char grey[4];
+    
+    char *renderASCII(char *out, const Tile *tiles, int width, int height) const;
+    char *renderRLE(char *out, const Tile *tiles, int width, int height) const;
+    char *renderPGM(char *out, const Tile *tiles, int width, int height) const;
+};
+
+#endif /* Renderer_hpp */
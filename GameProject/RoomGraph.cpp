@@ -0,0 +1,497 @@
+//
+//  RoomGraph.cpp
+//  GameProject
+//
+//  Created by Orin Elmquist on 6/12/18.
+//  Copyright © 2018 Orin Elmquist. All rights reserved.
+//
+
+#include "RoomGraph.hpp"
+#include "Trace.hpp"
+#include <algorithm>
+#include <functional>
+
+const size_t DEFAULT_CACHE_LIMIT = 4096;
+
+static uint32_t manhattan(int x1, int y1, int x2, int y2) {
+    return abs(x1 - x2) + abs(y1 - y2);
+}
+
+RoomGraph::RoomGraph() : world(NULL), version(0), width(0), height(0), usable(false), epoch(0), cellEpoch(0), cacheLimit(DEFAULT_CACHE_LIMIT) { }
+
+
+/*
+ Building the graph
+
+ build:
+     Doors come from the halls, each room's doors are linked pairwise. The graph is only used if
+     every room interior, hall and door is still open, a map edited since buildDungeon could
+     otherwise send a path through a wall.
+
+ addDoor:
+     The door's inner cell is the room tile just inside the doorway, every path into or out of
+     the room goes through it.
+ */
+
+void RoomGraph::build(const World &w) {
+    TRACE_SCOPE("RoomGraph::build");
+    const std::vector<Room> &rooms = w.getRooms();
+    int maxSide = 1;
+
+    world = &w;
+    version = w.getVersion();
+    width = w.getWidth();
+    height = w.getHeight();
+    usable = !rooms.empty();
+
+    roomById.clear();
+    halls = w.getHalls();
+    doorList.clear();
+    hallDoors.clear();
+    doorAt.clear();
+    hallAt.clear();
+
+    for (const Room &r : rooms) {
+        if ((size_t)r.num() >= roomById.size())
+            roomById.resize(r.num() + 1);
+        roomById[r.num()] = r;
+        maxSide = std::max(maxSide, std::max(r.dim().first, r.dim().second));
+    }
+
+    grid.reset(width, height, maxSide + 2);
+    for (const Room &r : rooms) {
+        grid.insert(r);
+        for (int y = r.coords().second + 1; y < r.coords().second + r.dim().second; y++)
+            for (int x = r.coords().first + 1; x < r.coords().first + r.dim().first; x++)
+                if (!open(w, x, y))
+                    usable = false;
+    }
+
+    //Doors and the cells of every hall between them
+    for (int i = 0; i < (int)halls.size(); i++) {
+        const Hall &h = halls[i];
+        int sx = h.startPoint().first, sy = h.startPoint().second;
+        int ex = h.endPoint().first, ey = h.endPoint().second;
+
+        hallDoors.push_back(addDoor(sx, sy, h.rooms().first));
+        hallDoors.push_back(addDoor(ex, ey, h.rooms().second));
+
+        for (int y = sy; y <= ey; y++)
+            for (int x = sx; x <= ex; x++) {
+                if (!open(w, x, y))
+                    usable = false;
+                if ((x != sx || y != sy) && (x != ex || y != ey))
+                    hallAt[(uint64_t)y * width + x] = i;
+            }
+    }
+
+    //Doors of each room, grouped by room id
+    roomStart.assign(roomById.size() + 1, 0);
+    for (const Door &d : doorList)
+        roomStart[d.room + 1]++;
+    for (size_t r = 1; r < roomStart.size(); r++)
+        roomStart[r] += roomStart[r - 1];
+
+    std::vector<int> next(roomStart.begin(), roomStart.end() - 1);
+    roomDoors.resize(doorList.size());
+    for (int d = 0; d < (int)doorList.size(); d++)
+        roomDoors[next[doorList[d].room]++] = d;
+
+    //Links, grouped by door: its halls, then every other door of its room
+    linkStart.assign(doorList.size() + 1, 0);
+    for (size_t i = 0; i < hallDoors.size(); i++)
+        linkStart[hallDoors[i] + 1]++;
+    for (int d = 0; d < (int)doorList.size(); d++)
+        linkStart[d + 1] += roomStart[doorList[d].room + 1] - roomStart[doorList[d].room] - 1;
+    for (size_t d = 1; d < linkStart.size(); d++)
+        linkStart[d] += linkStart[d - 1];
+
+    next.assign(linkStart.begin(), linkStart.end() - 1);
+    links.resize(linkStart.back());
+
+    for (size_t i = 0; i < halls.size(); i++) {
+        int a = hallDoors[2 * i], b = hallDoors[2 * i + 1];
+        links[next[a]++] = {b, (uint32_t)halls[i].len(), true};
+        links[next[b]++] = {a, (uint32_t)halls[i].len(), true};
+    }
+
+    for (size_t r = 0; r + 1 < roomStart.size(); r++)
+        for (int i = roomStart[r]; i < roomStart[r + 1]; i++)
+            for (int j = roomStart[r]; j < roomStart[r + 1]; j++) {
+                const Door &a = doorList[roomDoors[i]], &b = doorList[roomDoors[j]];
+                if (i != j)
+                    links[next[roomDoors[i]]++] = {roomDoors[j], manhattan(a.innerX, a.innerY, b.innerX, b.innerY) + 2, false};
+            }
+
+    g.resize(doorList.size());
+    goalCost.resize(doorList.size());
+    parent.resize(doorList.size());
+    viaHall.resize(doorList.size());
+    stamp.assign(doorList.size(), 0);
+    goalStamp.assign(doorList.size(), 0);
+    epoch = 0;
+}
+
+int RoomGraph::addDoor(int x, int y, int room) {
+    auto found = doorAt.find((uint64_t)y * width + x);
+    Door d;
+
+    if (found != doorAt.end())
+        return found->second;
+
+    const Room &r = roomById[room];
+    d.x = d.innerX = x;
+    d.y = d.innerY = y;
+    d.room = room;
+
+    if (y == r.coords().second)
+        d.innerY++;
+    else if (y == r.coords().second + r.dim().second)
+        d.innerY--;
+    else if (x == r.coords().first)
+        d.innerX++;
+    else
+        d.innerX--;
+
+    doorList.push_back(d);
+    doorAt[(uint64_t)y * width + x] = (int)doorList.size() - 1;
+    return (int)doorList.size() - 1;
+}
+
+
+/*
+ Locating points
+
+ locate - whether a point is a doorway, in a hall or inside a room
+ exits - the doors a located point can reach directly, with the steps to each
+ */
+
+bool RoomGraph::open(const World &w, int x, int y) const {
+    if (x < 0 || y < 0 || x >= w.getWidth() || y >= w.getHeight())
+        return false;
+
+    Tile t = w.tiles()[(size_t)y * w.getWidth() + x];
+    return t == FLOOR || t == DOOR;
+}
+
+RoomGraph::Place RoomGraph::locate(int x, int y) const {
+    Place p = {NONE, -1, x, y};
+    auto found = doorAt.find((uint64_t)y * width + x);
+
+    if (found != doorAt.end()) {
+        p.kind = AT_DOOR;
+        p.id = found->second;
+        return p;
+    }
+
+    found = hallAt.find((uint64_t)y * width + x);
+    if (found != hallAt.end()) {
+        p.kind = IN_HALL;
+        p.id = found->second;
+        return p;
+    }
+
+    grid.any(x, y, x, y, [&](const Room &r) {
+        if (x > r.coords().first && x < r.coords().first + r.dim().first &&
+            y > r.coords().second && y < r.coords().second + r.dim().second) {
+            p.kind = IN_ROOM;
+            p.id = r.num();
+            return true;
+        }
+        return false;
+    });
+
+    return p;
+}
+
+void RoomGraph::exits(const Place &p, std::vector<Exit> &out) const {
+    out.clear();
+
+    switch (p.kind) {
+        case AT_DOOR:
+            out.push_back({p.id, 0});
+            break;
+
+        case IN_HALL:
+            for (int d : {hallDoors[2 * p.id], hallDoors[2 * p.id + 1]})
+                out.push_back({d, manhattan(p.x, p.y, doorList[d].x, doorList[d].y)});
+            break;
+
+        case IN_ROOM:
+            for (int i = roomStart[p.id]; i < roomStart[p.id + 1]; i++) {
+                const Door &d = doorList[roomDoors[i]];
+                out.push_back({roomDoors[i], manhattan(p.x, p.y, d.innerX, d.innerY) + 1});
+            }
+            break;
+    }
+}
+
+
+/*
+ Queries
+
+ findPath:
+     Cached by start and goal. A failed search through the graph is retried on the grid before
+     giving up, so a cut off room still gets the right answer.
+
+ graphPath:
+     A* over the doors from the start's exits to the goal's, with the Manhattan distance to the
+     goal as the estimate. Two points in the same room or the same hall are joined directly.
+     The route is then walked out tile by tile: halls are straight, and a room is crossed from
+     inner cell to inner cell, x first then y, which stays inside the open interior.
+
+ gridPath:
+     A* over the tiles. Ties on the estimate go to the deeper node, which keeps the search
+     close to a straight line on open floor.
+ */
+
+bool RoomGraph::findPath(const World &w, int x1, int y1, int x2, int y2, Path &path) {
+    TRACE_SCOPE("RoomGraph::findPath");
+    bool found;
+
+    if (world != &w || version != w.getVersion()) {
+        build(w);
+        cache.clear();
+    }
+
+    path.clear();
+    if (!open(w, x1, y1) || !open(w, x2, y2))
+        return false;
+
+    Ends key((size_t)y1 * width + x1, (size_t)y2 * width + x2);
+    auto hit = cache.find(key);
+    if (hit != cache.end()) {
+        path = hit->second;
+        return !path.empty();
+    }
+
+    Place from = locate(x1, y1), to = locate(x2, y2);
+
+    found = usable && from.kind != NONE && to.kind != NONE && graphPath(from, to, path);
+    if (!found)
+        found = gridPath(w, x1, y1, x2, y2, path);
+
+    if (cache.size() >= cacheLimit)
+        cache.clear();
+    if (cacheLimit > 0)
+        cache[key] = path;
+
+    return found;
+}
+
+bool RoomGraph::graphPath(const Place &from, const Place &to, Path &path) {
+    std::greater<Entry> later;
+    uint32_t best = UINT32_MAX;
+    int bestDoor = -1;
+
+    path.clear();
+    path.push_back(std::make_pair(from.x, from.y));
+
+    if ((from.x == to.x && from.y == to.y) || (from.kind == to.kind && from.kind != AT_DOOR && from.id == to.id)) {
+        walk(path, to.x, to.y);
+        return true;
+    }
+
+    auto estimate = [&](int d) {
+        return manhattan(doorList[d].x, doorList[d].y, to.x, to.y);
+    };
+
+    if (++epoch == 0) {
+        std::fill(stamp.begin(), stamp.end(), 0);
+        std::fill(goalStamp.begin(), goalStamp.end(), 0);
+        epoch = 1;
+    }
+
+    exits(from, starts);
+    exits(to, goals);
+    doorHeap.clear();
+
+    for (const Exit &e : goals)
+        if (goalStamp[e.door] != epoch || e.cost < goalCost[e.door]) {
+            goalStamp[e.door] = epoch;
+            goalCost[e.door] = e.cost;
+        }
+
+    for (const Exit &e : starts)
+        if (stamp[e.door] != epoch || e.cost < g[e.door]) {
+            stamp[e.door] = epoch;
+            g[e.door] = e.cost;
+            parent[e.door] = -1;
+            viaHall[e.door] = false;
+            doorHeap.push_back(Entry(e.cost + estimate(e.door), e.door));
+            std::push_heap(doorHeap.begin(), doorHeap.end(), later);
+        }
+
+    while (!doorHeap.empty()) {
+        std::pop_heap(doorHeap.begin(), doorHeap.end(), later);
+        Entry top = doorHeap.back();
+        int d = top.second;
+        doorHeap.pop_back();
+
+        if (top.first >= best)
+            break;
+        if (top.first != g[d] + estimate(d))
+            continue;
+
+        if (goalStamp[d] == epoch && g[d] + goalCost[d] < best) {
+            best = g[d] + goalCost[d];
+            bestDoor = d;
+        }
+
+        for (int i = linkStart[d]; i < linkStart[d + 1]; i++) {
+            const Link &l = links[i];
+            uint32_t ng = g[d] + l.cost;
+
+            if (stamp[l.to] != epoch || ng < g[l.to]) {
+                stamp[l.to] = epoch;
+                g[l.to] = ng;
+                parent[l.to] = d;
+                viaHall[l.to] = l.hall;
+                doorHeap.push_back(Entry(ng + estimate(l.to), l.to));
+                std::push_heap(doorHeap.begin(), doorHeap.end(), later);
+            }
+        }
+    }
+
+    if (bestDoor < 0) {
+        path.clear();
+        return false;
+    }
+
+    //Doors on the route, first to last
+    route.clear();
+    for (int d = bestDoor; d >= 0; d = parent[d])
+        route.push_back(d);
+    std::reverse(route.begin(), route.end());
+
+    const Door &first = doorList[route.front()], &last = doorList[route.back()];
+
+    if (from.kind == IN_ROOM)
+        walk(path, first.innerX, first.innerY);
+    walk(path, first.x, first.y);
+
+    for (size_t i = 1; i < route.size(); i++) {
+        const Door &a = doorList[route[i - 1]], &b = doorList[route[i]];
+        if (!viaHall[route[i]]) {
+            walk(path, a.innerX, a.innerY);
+            walk(path, b.innerX, b.innerY);
+        }
+        walk(path, b.x, b.y);
+    }
+
+    if (to.kind == IN_ROOM)
+        walk(path, last.innerX, last.innerY);
+    walk(path, to.x, to.y);
+
+    return true;
+}
+
+void RoomGraph::walk(Path &path, int x, int y) {
+    int cx = path.back().first, cy = path.back().second;
+
+    while (cx != x) {
+        cx += cx < x ? 1 : -1;
+        path.push_back(std::make_pair(cx, cy));
+    }
+    while (cy != y) {
+        cy += cy < y ? 1 : -1;
+        path.push_back(std::make_pair(cx, cy));
+    }
+}
+
+bool RoomGraph::gridPath(const World &w, int x1, int y1, int x2, int y2, Path &path) {
+    TRACE_SCOPE("RoomGraph::gridPath");
+    int W = w.getWidth();
+    size_t cells = (size_t)W * w.getHeight();
+    std::greater<CellEntry> later;
+    const int dx[4] = {0, 1, 0, -1}, dy[4] = {-1, 0, 1, 0};
+
+    path.clear();
+    if (!open(w, x1, y1) || !open(w, x2, y2))
+        return false;
+
+    if (cellStamp.size() != cells) {
+        cellStamp.assign(cells, 0);
+        cellG.resize(cells);
+        cellParent.resize(cells);
+        cellEpoch = 0;
+    }
+    if (++cellEpoch == 0) {
+        std::fill(cellStamp.begin(), cellStamp.end(), 0);
+        cellEpoch = 1;
+    }
+
+    //Lowest estimate first, ties to the larger g
+    auto push = [&](size_t i, uint32_t g) {
+        uint64_t f = (uint64_t)g + manhattan((int)(i % W), (int)(i / W), x2, y2);
+        heap.push_back(CellEntry(f, UINT32_MAX - g, i));
+        std::push_heap(heap.begin(), heap.end(), later);
+    };
+
+    size_t s = (size_t)y1 * W + x1, t = (size_t)y2 * W + x2;
+    heap.clear();
+    cellStamp[s] = cellEpoch;
+    cellG[s] = 0;
+    cellParent[s] = s;
+    push(s, 0);
+
+    while (!heap.empty()) {
+        std::pop_heap(heap.begin(), heap.end(), later);
+        size_t i = std::get<2>(heap.back());
+        uint32_t g = UINT32_MAX - std::get<1>(heap.back());
+        heap.pop_back();
+
+        if (g != cellG[i])
+            continue;
+        if (i == t)
+            break;
+
+        int x = (int)(i % W), y = (int)(i / W);
+        for (int d = 0; d < 4; d++) {
+            if (!open(w, x + dx[d], y + dy[d]))
+                continue;
+
+            size_t n = (size_t)(y + dy[d]) * W + x + dx[d];
+            if (cellStamp[n] != cellEpoch || g + 1 < cellG[n]) {
+                cellStamp[n] = cellEpoch;
+                cellG[n] = g + 1;
+                cellParent[n] = i;
+                push(n, g + 1);
+            }
+        }
+    }
+
+    if (cellStamp[t] != cellEpoch)
+        return false;
+
+    for (size_t i = t; ; i = cellParent[i]) {
+        path.push_back(std::make_pair((int)(i % W), (int)(i / W)));
+        if (i == s)
+            break;
+    }
+    std::reverse(path.begin(), path.end());
+    return true;
+}
+
+
+/*
+ Cache and counts
+ */
+
+void RoomGraph::setCacheLimit(size_t paths) {
+    cacheLimit = paths;
+    if (cache.size() > cacheLimit)
+        cache.clear();
+}
+
+size_t RoomGraph::EndsHash::operator()(const Ends &e) const {
+    return std::hash<size_t>()(e.first * 0x9E3779B97F4A7C15ULL ^ e.second);
+}
+
+size_t RoomGraph::cached() const {
+    return cache.size();
+}
+
+size_t RoomGraph::doors() const {
+    return doorList.size();
+}
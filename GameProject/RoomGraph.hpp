@@ -0,0 +1,134 @@
+//
+//  RoomGraph.hpp
+//  GameProject
+//
+//  Created by Orin Elmquist on 6/12/18.
+//  Copyright © 2018 Orin Elmquist. All rights reserved.
+//
+
+#ifndef RoomGraph_hpp
+#define RoomGraph_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+#include <unordered_map>
+#include <tuple>
+#include "World.hpp"
+
+/*
+ RoomGraph - hierarchical pathfinding over a dungeon's rooms and halls.
+
+ Every door is a node. A hall links its two doors at its length, and the doors of one room are
+ linked to each other at the cost of crossing the room, which is open, so that is a Manhattan
+ distance (plus the steps in and out of the doorways). A long query searches this graph with A*,
+ tiles are only walked inside the start and goal rooms and along the halls the route takes.
+
+ findPath - shortest path from (x1, y1) to (x2, y2) over FLOOR and DOOR tiles, both ends included.
+            Points in a room, a hall or a doorway use the graph, anything else (caves, or a map
+            that was edited after buildDungeon) falls back to gridPath. False if there is no path.
+ gridPath - plain A* over the tiles, also used as the fallback.
+
+ Routes through the graph are shortest among routes through doors. Two halls that happen to run
+ side by side make a shortcut the graph does not know about, so the odd path can be longer than
+ the grid's. The graph is rebuilt and the cache cleared whenever World::getVersion changes. Up to
+ the cache limit of paths are kept, the cache is emptied when it fills.
+ */
+
+class RoomGraph {
+public:
+    typedef std::vector<std::pair<int, int>> Path;
+
+    RoomGraph();
+
+    bool findPath(const World &w, int x1, int y1, int x2, int y2, Path &path);
+    bool gridPath(const World &w, int x1, int y1, int x2, int y2, Path &path);
+
+    void setCacheLimit(size_t paths);
+    size_t cached() const;
+    size_t doors() const;
+
+private:
+    enum {
+        NONE,
+        IN_ROOM,
+        IN_HALL,
+        AT_DOOR
+    };
+
+    //A point located in the layout, id is the room, hall or door
+    struct Place {
+        int kind, id, x, y;
+    };
+
+    struct Door {
+        int x, y, innerX, innerY, room;
+    };
+
+    struct Link {
+        int to;
+        uint32_t cost;
+        bool hall;
+    };
+
+    struct Exit {
+        int door;
+        uint32_t cost;
+    };
+
+    //Estimated total cost and door
+    typedef std::pair<uint32_t, int> Entry;
+
+    //Estimated total cost, UINT32_MAX - cost so far, and cell
+    typedef std::tuple<uint64_t, uint32_t, size_t> CellEntry;
+
+    //Start and goal cells, the key of a cached path
+    typedef std::pair<size_t, size_t> Ends;
+
+    struct EndsHash {
+        size_t operator()(const Ends &e) const;
+    };
+
+    //Layout
+    const World *world;
+    uint64_t version;
+    int width, height;
+    bool usable;
+    std::vector<Room> roomById;
+    std::vector<Hall> halls;
+    std::vector<Door> doorList;
+    std::vector<int> hallDoors;
+    std::vector<int> roomStart, roomDoors;
+    std::vector<int> linkStart;
+    std::vector<Link> links;
+    std::unordered_map<uint64_t, int> doorAt, hallAt;
+    RoomGrid grid;
+
+    //Graph search scratch, entries are current when their stamp matches epoch
+    std::vector<uint32_t> g, goalCost, stamp, goalStamp;
+    std::vector<int> parent;
+    std::vector<bool> viaHall;
+    std::vector<Exit> starts, goals;
+    std::vector<Entry> doorHeap;
+    std::vector<int> route;
+    uint32_t epoch;
+
+    //Grid search scratch
+    std::vector<uint32_t> cellG, cellStamp;
+    std::vector<size_t> cellParent;
+    std::vector<CellEntry> heap;
+    uint32_t cellEpoch;
+
+    std::unordered_map<Ends, Path, EndsHash> cache;
+    size_t cacheLimit;
+
+    void build(const World &w);
+    int addDoor(int x, int y, int room);
+    bool open(const World &w, int x, int y) const;
+    Place locate(int x, int y) const;
+    void exits(const Place &p, std::vector<Exit> &out) const;
+    bool graphPath(const Place &from, const Place &to, Path &path);
+    static void walk(Path &path, int x, int y);
+};
+
+#endif /* RoomGraph_hpp */
@@ -0,0 +1,269 @@
+//
+//  StaticWorld.hpp
+//  GameProject
+//
+//  Created by Orin Elmquist on 6/12/18.
+//  Copyright © 2018 Orin Elmquist. All rights reserved.
+//
+
+#ifndef StaticWorld_hpp
+#define StaticWorld_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <array>
+#include <vector>
+#include "World.hpp"
+#include "Trace.hpp"
+
+/*
+ StaticWorld<W, H> - a cave with its size fixed at compile time, for the handful of sizes levels
+ ship in. Storage is std::array, every index and neighbor offset is a constant, and the kernels'
+ loop bounds are known, so the compiler can unroll and vectorize them.
+
+ The same seed gives the same cave as World::buildCave with the default smoothing, tile for tile.
+ The border is always wall, so the flood fill needs no bounds checks. A 1000x1000 StaticWorld is
+ about 10MB, allocate the big ones with new rather than on the stack.
+
+ buildCave, fillCave, smoothCave, cleanCave - as in World
+ render - the ASCII text Renderer makes, TEXT_SIZE bytes
+ */
+
+template <int W, int H>
+class StaticWorld final : public TileMap {
+    static_assert(W >= 3 && H >= 3, "StaticWorld needs room for a border");
+
+public:
+    static constexpr int WORDS = (W + 63) / 64;
+    static constexpr size_t CELLS = (size_t)W * H;
+    static constexpr size_t TEXT_SIZE = (size_t)(W + 1) * H;
+
+    //North, east, south and west, as offsets into the tile array
+    static constexpr ptrdiff_t NEIGHBORS[4] = {-W, 1, W, -1};
+
+    StaticWorld(uint64_t seed = 0);
+
+    void seed(uint64_t s);
+
+    void buildCave();
+    void fillCave();
+    void smoothCave(int passes = DEFAULT_SMOOTH_PASSES);
+    void cleanCave();
+
+    void render(char *out) const;
+
+    int getWidth() const override;
+    int getHeight() const override;
+    const Tile *tiles() const override;
+    int get(int x, int y) const;
+
+private:
+    //Inner bits of the first and last word of a row, the border columns are never smoothed
+    static constexpr uint64_t FIRST_INNER = ~(uint64_t)1;
+    static constexpr uint64_t LAST_INNER = ((W % 64) ? ((uint64_t)1 << (W % 64)) - 1 : ~(uint64_t)0) >> 1;
+
+    std::array<Tile, CELLS> map;
+    std::array<uint64_t, (size_t)WORDS * H> cells, cellsTemp;
+    std::array<int32_t, CELLS> region;
+    std::array<uint32_t, CELLS> stack;
+    std::vector<size_t> sizes;
+    Random rng;
+
+    static constexpr size_t index(int x, int y) {
+        return (size_t)y * W + x;
+    }
+
+    static void smoothPass(const uint64_t *src, uint64_t *dst);
+    size_t flood(uint32_t start, int32_t label);
+};
+
+
+/*
+ Cave Build Functions
+
+ fillCave - the same Philox stream as World::fillCave, so the same seed gives the same noise
+ smoothCave - the bit-sliced pass from Bitboard, ping-ponging between the two arrays
+ cleanCave - labels regions by flood fill in row order, then walls in all but the largest, which
+             is the first of the largest in row order, as in World::keepRegions
+ */
+
+template <int W, int H>
+StaticWorld<W, H>::StaticWorld(uint64_t seed) : rng(seed) {
+    map.fill(WALL);
+}
+
+template <int W, int H>
+void StaticWorld<W, H>::seed(uint64_t s) {
+    rng.seed(s);
+}
+
+template <int W, int H>
+void StaticWorld<W, H>::buildCave() {
+    TRACE_SCOPE("StaticWorld::buildCave");
+
+    fillCave();
+    smoothCave();
+    cleanCave();
+}
+
+template <int W, int H>
+void StaticWorld<W, H>::fillCave() {
+    TRACE_SCOPE("StaticWorld::fillCave");
+    map.fill(WALL);
+
+    for (int y = 1; y < H - 1; y++)
+        for (int x = 1; x < W - 1; x++)
+            if (rng.at(STREAM_CAVE, index(x, y), 100) > CAVE_PERCENT_WALL)
+                map[index(x, y)] = FLOOR;
+
+    //Walls are set bits
+    for (int y = 0; y < H; y++)
+        for (int i = 0; i < WORDS; i++) {
+            uint64_t word = 0;
+            for (int b = 0; b < 64 && i * 64 + b < W; b++)
+                word |= (uint64_t)(map[index(i * 64 + b, y)] == WALL) << b;
+            cells[(size_t)y * WORDS + i] = word;
+        }
+}
+
+template <int W, int H>
+void StaticWorld<W, H>::smoothPass(const uint64_t *src, uint64_t *dst) {
+    std::copy(src, src + WORDS, dst);
+    std::copy(src + (size_t)(H - 1) * WORDS, src + (size_t)H * WORDS, dst + (size_t)(H - 1) * WORDS);
+
+    for (int y = 1; y < H - 1; y++) {
+        const uint64_t *n = src + (size_t)(y - 1) * WORDS, *c = n + WORDS, *s = c + WORDS;
+        uint64_t *out = dst + (size_t)y * WORDS;
+        uint64_t p0 = 0, p1 = 0, c0, c1, n0 = 0, n1 = 0;
+
+        Bitboard::columnSum(n[0], c[0], s[0], c0, c1);
+
+        for (int i = 0; i < WORDS; i++) {
+            if (i + 1 < WORDS)
+                Bitboard::columnSum(n[i + 1], c[i + 1], s[i + 1], n0, n1);
+            else
+                n0 = n1 = 0;
+
+            uint64_t inner = (i == 0 ? FIRST_INNER : ~(uint64_t)0) & (i == WORDS - 1 ? LAST_INNER : ~(uint64_t)0);
+            out[i] = (Bitboard::nextWord(p0, p1, c0, c1, n0, n1) & inner) | (c[i] & ~inner);
+
+            p0 = c0;
+            p1 = c1;
+            c0 = n0;
+            c1 = n1;
+        }
+    }
+}
+
+template <int W, int H>
+void StaticWorld<W, H>::smoothCave(int passes) {
+    TRACE_SCOPE("StaticWorld::smoothCave");
+    uint64_t *src = cells.data(), *dst = cellsTemp.data();
+
+    for (int i = 0; i < passes; i++) {
+        smoothPass(src, dst);
+        std::swap(src, dst);
+    }
+
+    for (int y = 0; y < H; y++) {
+        const uint64_t *r = src + (size_t)y * WORDS;
+        for (int x = 0; x < W; x++)
+            map[index(x, y)] = (r[x >> 6] >> (x & 63)) & 1 ? WALL : FLOOR;
+    }
+
+    if (src != cells.data())
+        cells = cellsTemp;
+}
+
+template <int W, int H>
+size_t StaticWorld<W, H>::flood(uint32_t start, int32_t label) {
+    size_t top = 0, count = 0;
+
+    region[start] = label;
+    stack[top++] = start;
+
+    while (top > 0) {
+        uint32_t i = stack[--top];
+        count++;
+
+        for (int d = 0; d < 4; d++) {
+            uint32_t n = (uint32_t)(i + NEIGHBORS[d]);
+            if (map[n] != WALL && region[n] < 0) {
+                region[n] = label;
+                stack[top++] = n;
+            }
+        }
+    }
+
+    return count;
+}
+
+template <int W, int H>
+void StaticWorld<W, H>::cleanCave() {
+    TRACE_SCOPE("StaticWorld::cleanCave");
+    int32_t largest;
+
+    region.fill(-1);
+    sizes.clear();
+
+    for (uint32_t i = 0; i < CELLS; i++)
+        if (map[i] != WALL && region[i] < 0)
+            sizes.push_back(flood(i, (int32_t)sizes.size()));
+
+    if (sizes.empty())
+        return;
+
+    largest = (int32_t)(std::max_element(sizes.begin(), sizes.end()) - sizes.begin());
+    for (size_t i = 0; i < CELLS; i++)
+        if (region[i] >= 0 && region[i] != largest)
+            map[i] = WALL;
+}
+
+
+/*
+ Rendering and value retrevial
+ */
+
+//Selects rather than a table lookup, and a row at a time through a local copy, so the row loop
+//vectorizes without the compiler having to prove out and map do not overlap
+template <int W, int H>
+void StaticWorld<W, H>::render(char *out) const {
+    for (int y = 0; y < H; y++) {
+        Tile row[W];
+        char text[W + 1];
+
+        std::copy(&map[index(0, y)], &map[index(0, y)] + W, row);
+        for (int x = 0; x < W; x++) {
+            char g = row[x] == WALL ? '#' : ' ';
+            g = row[x] == DOOR ? 'D' : g;
+            text[x] = row[x] > DOOR ? '?' : g;
+        }
+        text[W] = '\n';
+
+        std::copy(text, text + W + 1, out);
+        out += W + 1;
+    }
+}
+
+template <int W, int H>
+int StaticWorld<W, H>::getWidth() const {
+    return W;
+}
+
+template <int W, int H>
+int StaticWorld<W, H>::getHeight() const {
+    return H;
+}
+
+template <int W, int H>
+const Tile *StaticWorld<W, H>::tiles() const {
+    return map.data();
+}
+
+template <int W, int H>
+int StaticWorld<W, H>::get(int x, int y) const {
+    return map[index(x, y)];
+}
+
+#endif /* StaticWorld_hpp */
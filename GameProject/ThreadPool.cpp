@@ -0,0 +1,155 @@
+//
+//  ThreadPool.cpp
+//  GameProject
+//
+//  Created by Orin Elmquist on 6/12/18.
+//  Copyright © 2018 Orin Elmquist. All rights reserved.
+//
+
+#include "ThreadPool.hpp"
+
+/*
+ Constructor - threads is the total parallelism including the calling thread,
+ 0 uses one per hardware thread
+ */
+
+ThreadPool::ThreadPool(unsigned threads) : job({NULL, NULL}), busy(0), generation(0), stopping(false) {
+    if (threads == 0)
+        threads = std::thread::hardware_concurrency();
+    if (threads == 0)
+        threads = 1;
+
+    slices.reset(new Slice[threads]);
+    for (unsigned i = 0; i < threads; i++)
+        slices[i].begin = slices[i].end = 0;
+    
+    for (unsigned i = 1; i < threads; i++)
+        workers.push_back(std::thread(&ThreadPool::work, this, i));
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread &t : workers)
+        t.join();
+}
+
+unsigned ThreadPool::size() const {
+    return (unsigned)workers.size() + 1;
+}
+
+
+/*
+ Task distribution
+ */
+
+void ThreadPool::start(size_t n, const Task &task) {
+    if (n == 0)
+        return;
+
+    if (workers.empty() || n == 1) {
+        for (size_t i = 0; i < n; i++)
+            task.call(task.fn, i, 0);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        unsigned threads = size();
+        for (unsigned i = 0; i < threads; i++) {
+            std::lock_guard<std::mutex> sliceGuard(slices[i].lock);
+            slices[i].begin = n * i / threads;
+            slices[i].end = n * (i + 1) / threads;
+        }
+        job = task;
+        busy = (unsigned)workers.size();
+        generation++;
+    }
+    wake.notify_all();
+
+    drain(0);
+
+    std::unique_lock<std::mutex> guard(lock);
+    done.wait(guard, [this] { return busy == 0; });
+    job.fn = NULL;
+}
+
+void ThreadPool::drain(unsigned self) {
+    size_t i;
+    
+    do {
+        while (take(self, i))
+            job.call(job.fn, i, self);
+    } while (steal(self));
+}
+
+bool ThreadPool::take(unsigned self, size_t &task) {
+    std::lock_guard<std::mutex> guard(slices[self].lock);
+    if (slices[self].begin >= slices[self].end)
+        return false;
+    task = slices[self].begin++;
+    return true;
+}
+
+bool ThreadPool::steal(unsigned self) {
+    unsigned threads = size();
+    
+    while (true) {
+        unsigned victim = self;
+        size_t most = 0;
+        
+        //Pick the largest slice, then check it again once both locks are held
+        for (unsigned i = 0; i < threads; i++) {
+            if (i == self)
+                continue;
+            std::lock_guard<std::mutex> guard(slices[i].lock);
+            size_t left = slices[i].end - slices[i].begin;
+            if (slices[i].begin < slices[i].end && left > most) {
+                most = left;
+                victim = i;
+            }
+        }
+        
+        if (victim == self)
+            return false;
+        
+        std::lock(slices[self].lock, slices[victim].lock);
+        std::lock_guard<std::mutex> a(slices[self].lock, std::adopt_lock);
+        std::lock_guard<std::mutex> b(slices[victim].lock, std::adopt_lock);
+        
+        Slice &v = slices[victim];
+        if (v.begin >= v.end)
+            continue;
+        
+        size_t half = (v.end - v.begin + 1) / 2;
+        slices[self].begin = v.end - half;
+        slices[self].end = v.end;
+        v.end -= half;
+        return true;
+    }
+}
+
+void ThreadPool::work(unsigned self) {
+    unsigned seen = 0;
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            wake.wait(guard, [this, seen] { return stopping || generation != seen; });
+            if (stopping)
+                return;
+            seen = generation;
+        }
+
+        drain(self);
+
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if (--busy == 0)
+                done.notify_one();
+        }
+    }
+}
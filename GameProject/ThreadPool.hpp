@@ -0,0 +1,75 @@
+//
+//  ThreadPool.hpp
+//  GameProject
+//
+//  Created by Orin Elmquist on 6/12/18.
+//  Copyright © 2018 Orin Elmquist. All rights reserved.
+//
+
+#ifndef ThreadPool_hpp
+#define ThreadPool_hpp
+
+#include <stdio.h>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+/*
+ ThreadPool - fixed set of worker threads that run indexed tasks.
+ run() hands out tasks 0..count-1, the calling thread helps, and it returns once every task
+ has finished, so back to back calls act as a barrier between passes.
+
+ Each thread starts with an even slice of the task range and takes tasks from the front of it.
+ A thread that runs out steals the back half of the largest remaining slice, so uneven tasks
+ (worlds that take longer to build) still keep every thread busy.
+ The task function gets the task index and the index of the thread running it (0 is the caller),
+ which lets callers keep per-thread scratch data. run() only keeps a pointer to it while the
+ tasks run, so handing it a lambda does not allocate.
+ */
+
+class ThreadPool {
+public:
+    ThreadPool(unsigned threads = 0);
+    ~ThreadPool();
+
+    template <typename Fn>
+    void run(size_t count, const Fn &task);
+    unsigned size() const;
+
+private:
+    //The caller's task function, called through a plain function pointer
+    struct Task {
+        const void *fn;
+        void (*call)(const void *fn, size_t task, unsigned thread);
+    };
+    
+    struct alignas(64) Slice {
+        std::mutex lock;
+        size_t begin, end;
+    };
+    
+    std::vector<std::thread> workers;
+    std::unique_ptr<Slice[]> slices;
+    std::mutex lock;
+    std::condition_variable wake, done;
+    Task job;
+    unsigned busy, generation;
+    bool stopping;
+
+    void start(size_t count, const Task &task);
+    void work(unsigned self);
+    void drain(unsigned self);
+    bool take(unsigned self, size_t &task);
+    bool steal(unsigned self);
+};
+
+template <typename Fn>
+void ThreadPool::run(size_t count, const Fn &task) {
+    start(count, {&task, [](const void *fn, size_t i, unsigned thread) {
+        (*(const Fn *)fn)(i, thread);
+    }});
+}
+
+#endif /* ThreadPool_hpp */
@@ -0,0 +1,40 @@
+//
+//  TileMap.hpp
+//  GameProject
+//
+//  Created by Orin Elmquist on 6/12/18.
+//  Copyright © 2018 Orin Elmquist. All rights reserved.
+//
+
+#ifndef TileMap_hpp
+#define TileMap_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+
+enum {
+    FLOOR = 0,
+    WALL  = 1,
+    DOOR  = 2
+};
+
+//One byte per tile, the values above
+typedef uint8_t Tile;
+
+/*
+ TileMap - read only view of a grid of tiles, width * height of them in row order.
+ World, StaticWorld and MappedWorld all implement it, so code that only reads tiles (Renderer,
+ FlowField) takes a TileMap and works on any of them. The calls are made once per operation,
+ never per tile, and the classes are final, so calls through them directly are not virtual.
+ */
+
+class TileMap {
+public:
+    virtual ~TileMap() { }
+    
+    virtual int getWidth() const = 0;
+    virtual int getHeight() const = 0;
+    virtual const Tile *tiles() const = 0;
+};
+
+#endif /* TileMap_hpp */
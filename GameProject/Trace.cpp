@@ -0,0 +1,103 @@
+//
+//  Trace.cpp
+//  GameProject
+//
+//  Created by Orin Elmquist on 6/12/18.
+//  Copyright © 2018 Orin Elmquist. All rights reserved.
+//
+
+#include "Trace.hpp"
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+//Every buffer ever registered, owned here and never freed
+static std::mutex buffersLock;
+static std::vector<TraceBuffer *> buffers;
+
+//Timestamps count from here, the pair is used to convert counter ticks to time
+static const std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+static const uint64_t originTicks = Trace::now();
+
+thread_local TraceBuffer *Trace::buffer = NULL;
+
+TraceBuffer::TraceBuffer(unsigned _tid) : head(0), tid(_tid) { }
+
+
+/*
+ Recording
+ now - ticks, time stamp counter cycles or steady clock nanoseconds
+ clockNow - nanoseconds on the steady clock since origin
+ */
+
+uint64_t Trace::clockNow() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - origin).count();
+}
+
+TraceBuffer *Trace::registerThread() {
+    std::lock_guard<std::mutex> guard(buffersLock);
+    
+    buffers.push_back(new TraceBuffer((unsigned)buffers.size()));
+    return buffers.back();
+}
+
+
+/*
+ Output
+ 
+ write:
+     Writes every buffered span as a complete ("X") event, times in microseconds, with a
+     thread_name entry per buffer. False if the file could not be written.
+     Ticks per nanosecond are measured over the time since origin, so the longer the program
+     has run the closer the conversion.
+ 
+ flush:
+     write to path, then clear.
+ */
+
+bool Trace::write(FILE *file) {
+    std::lock_guard<std::mutex> guard(buffersLock);
+    uint64_t elapsed = clockNow(), ticks = now() - originTicks;
+    double usPerTick = elapsed > 0 && ticks > 0 ? elapsed / 1000.0 / ticks : 0.001;
+    bool first = true;
+    
+    fprintf(file, "{\"traceEvents\":[\n");
+    
+    for (TraceBuffer *b : buffers) {
+        uint64_t head = b->head.load(std::memory_order_acquire);
+        uint64_t begin = head > TraceBuffer::CAPACITY ? head - TraceBuffer::CAPACITY : 0;
+        
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"thread %u\"}}",
+                first ? "" : ",\n", b->tid, b->tid);
+        first = false;
+        
+        for (uint64_t i = begin; i < head; i++) {
+            const TraceEvent &e = b->events[i & (TraceBuffer::CAPACITY - 1)];
+            fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                    e.name, b->tid, (e.start - originTicks) * usPerTick, e.duration * usPerTick);
+        }
+    }
+    
+    fprintf(file, "\n],\"displayTimeUnit\":\"ns\"}\n");
+    return !ferror(file);
+}
+
+bool Trace::flush(const char *path) {
+    FILE *file = fopen(path, "w");
+    bool ok;
+    
+    if (!file)
+        return false;
+    
+    ok = write(file);
+    ok = fclose(file) == 0 && ok;
+    clear();
+    return ok;
+}
+
+void Trace::clear() {
+    std::lock_guard<std::mutex> guard(buffersLock);
+    
+    for (TraceBuffer *b : buffers)
+        b->head.store(0, std::memory_order_release);
+}
@@ -0,0 +1,112 @@
+//
+//  Trace.hpp
+//  GameProject
+//
+//  Created by Orin Elmquist on 6/12/18.
+//  Copyright © 2018 Orin Elmquist. All rights reserved.
+//
+
+#ifndef Trace_hpp
+#define Trace_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <atomic>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define TRACE_TSC
+#endif
+
+/*
+ Timeline tracing, written as Chrome trace-event JSON (loads in Perfetto and chrome://tracing).
+ 
+ TRACE_SCOPE("name") records a span from that line to the end of the enclosing scope. Spans are
+ only recorded when built with THEGAME_TRACE (cmake -DTHEGAME_TRACE=ON), otherwise the macro is
+ empty. name must be a string literal, only the pointer is kept.
+ 
+ Span times are read from the time stamp counter on x86, a few cycles, and turned into
+ microseconds against the steady clock when written. Elsewhere the steady clock is read directly.
+ 
+ Each thread writes to its own ring buffer of TraceBuffer::CAPACITY spans, so recording takes
+ no lock; once full the oldest spans are overwritten. A thread's buffer is created and registered
+ the first time it records, and kept after the thread exits so its spans can still be written.
+ 
+ Trace::write and Trace::flush read every buffer. Call them while no spans are being recorded,
+ between batches for example, since a span written during the read can come out torn.
+ */
+
+struct TraceEvent {
+    const char *name;
+    uint64_t start, duration;
+};
+
+class TraceBuffer {
+public:
+    static const size_t CAPACITY = 1 << 16;
+    
+    TraceBuffer(unsigned tid);
+    
+    void record(const char *name, uint64_t start, uint64_t duration) {
+        uint64_t n = head.load(std::memory_order_relaxed);
+        events[n & (CAPACITY - 1)] = {name, start, duration};
+        head.store(n + 1, std::memory_order_release);
+    }
+    
+private:
+    friend class Trace;
+    
+    std::atomic<uint64_t> head;
+    TraceEvent events[CAPACITY];
+    unsigned tid;
+};
+
+class Trace {
+public:
+    static uint64_t now() {
+#ifdef TRACE_TSC
+        return __rdtsc();
+#else
+        return clockNow();
+#endif
+    }
+    
+    static TraceBuffer &local() {
+        if (!buffer)
+            buffer = registerThread();
+        return *buffer;
+    }
+    
+    static bool write(FILE *file);
+    static bool flush(const char *path);
+    static void clear();
+    
+private:
+    static thread_local TraceBuffer *buffer;
+    
+    static uint64_t clockNow();
+    static TraceBuffer *registerThread();
+};
+
+class TraceScope {
+public:
+    TraceScope(const char *name) : name(name), start(Trace::now()) { }
+    
+    ~TraceScope() {
+        Trace::local().record(name, start, Trace::now() - start);
+    }
+    
+private:
+    const char *name;
+    uint64_t start;
+};
+
+#define TRACE_CONCAT2(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT2(a, b)
+
+#ifdef THEGAME_TRACE
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+#else
+#define TRACE_SCOPE(name) ((void)0)
+#endif
+
+#endif /* Trace_hpp */
@@ -7,150 +7,155 @@
 //
 
 #include "World.hpp"
+#include "WorldFile.hpp"
+#include "Renderer.hpp"
+#include "Trace.hpp"
+#include <chrono>
 
 const int DEFAULT_MAP_SIZE = 100;
+const int MIN_ROOM_SIZE = 5;
 
-enum {
-    NORTH = 0,
-    EAST  = 1,
-    SOUTH = 2,
-    WEST  = 3
+//Adds the time until it goes out of scope to one GenerationStats field, nothing without stats
+class StageTimer {
+public:
+    StageTimer(GenerationStats *stats, double GenerationStats::*field) : stats(stats), field(field) {
+        if (stats)
+            start = std::chrono::steady_clock::now();
+    }
+    
+    ~StageTimer() {
+        if (stats)
+            stats->*field += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    
+private:
+    GenerationStats *stats;
+    double GenerationStats::*field;
+    std::chrono::steady_clock::time_point start;
 };
 
-enum {
-    FLOOR = 0,
-    WALL  = 1,
-    DOOR  = 2
-};
 
+/////////////////
+// World Class //
+/////////////////
 
-////////////////
-//Disjoint Set//
-////////////////
+/*
+ Cave Build Functions
+ 
+ buildCave:
+     percentWall - (Default 45) Bigger number for less floor space
+     pool - Optional, smooths the map in parallel row bands. Output is the same as without.
+ 
+ The stages can also be run one at a time, in this order:
+     fillCave - random walls and floors, loaded into the cell bitboard
+     smoothCave - smoothing passes, written back to the map
+     cleanCave - removes inaccessable caverns, only the largest region is kept
+ 
+ setSmoothing:
+     passes - (Default 5) automaton passes run by smoothCave
+     active - (Default false) use Bitboard::smoothActive, which only recomputes the cells near
+              the last pass's changes and stops once a pass changes nothing. Caves come out the
+              same either way, active is worth it for counts well past the default, where most
+              passes only move a thin fringe of cells.
+ */
 
-class DJS {
-public:
-    class Node {
-    public:
-        Node *parent;
-        int val;
-        int rank;
-        
-        Node(int _val) : val(_val), rank(0), parent(this) { };
-    };
+void World::buildCave(ThreadPool *pool) {
+    TRACE_SCOPE("World::buildCave");
     
-    DJS(size_t size);
-    Node* find(Node* i);
-    void merge(int i, int j);
-    bool connected();
-    bool connected(int first, int second);
+    if (stats)
+        stats->caves++;
     
-    std::vector<DJS::Node*> v;
-};
-
-DJS::DJS(size_t size) {
-    int value = 0;
-    for (size_t i = 0; i < size; i++)
-        v.push_back(new Node(value++));
+    fillCave(pool);
+    smoothCave(pool);
+    cleanCave();
 }
 
-DJS::Node* DJS::find(Node* n) {
-    int i = n->val;
-    if (v[i] != v[i]->parent)
-        v[i]->parent = find(v[i]->parent);
+void World::fillCave(ThreadPool *pool) {
+    TRACE_SCOPE("World::fillCave");
+    StageTimer timer(stats, &GenerationStats::fillSeconds);
+    int percentWall = CAVE_PERCENT_WALL;
+    rooms.clear();
+    halls.clear();
+    clear();
     
-    return v[i]->parent;
-}
-
-void DJS::merge(int i, int j) {
-    Node* a = find(v[i]);
-    Node* b = find(v[j]);
+    //Randomly Generate Walls and Floors, each cell draws from its own counter so bands can run in any order
+    //Bands write the map directly, set would have every band write regionsValid and version
+    auto fill = [&](int y1, int y2) {
+        for (int y = std::max(y1, 1); y < std::min(y2, height - 1); y++)
+            for (int x = 1; x < width - 1; x++)
+                if (rng.at(STREAM_CAVE, index(x, y), 100) > percentWall)
+                    map[index(x, y)] = FLOOR;
+    };
+    
+    //Walls are set bits
+    cells.resize(width, height);
     
-    if (a->rank > b->rank) {
-        b->parent = a;
+    if (pool) {
+        int band = Bitboard::bandHeight(height, *pool);
+        size_t bands = (height + band - 1) / band;
+        
+        pool->run(bands, [&](size_t b, unsigned) {
+            fill((int)b * band, std::min(height, (int)(b + 1) * band));
+            cells.load(map, WALL, (int)b * band, std::min(height, (int)(b + 1) * band));
+        });
     } else {
-        a->parent = b;
-        if (a->rank == b->rank)
-            b->rank++;
+        fill(0, height);
+        cells.load(map, WALL);
     }
+    
+    regionsValid = false;
+    version++;
 }
 
-bool DJS::connected() {
-    int c = v[0]->parent->val;
+void World::smoothCave(ThreadPool *pool) {
+    TRACE_SCOPE("World::smoothCave");
+    StageTimer timer(stats, &GenerationStats::smoothSeconds);
+    int run = smoothPasses;
     
-    for (size_t i = 1; i < v.size(); i++)
-        if (find(v[i])->val != c)
-            return false;
+    if (pool) {
+        int band = Bitboard::bandHeight(height, *pool);
+        size_t bands = (height + band - 1) / band;
+        
+        if (activeSmoothing)
+            run = cells.smoothActive(cellsTemp, smoothPasses, *pool);
+        else
+            cells.smooth(cellsTemp, smoothPasses, *pool);
+        pool->run(bands, [&](size_t b, unsigned) {
+            cells.store(map, WALL, FLOOR, (int)b * band, std::min(height, (int)(b + 1) * band));
+        });
+    } else {
+        if (activeSmoothing)
+            run = cells.smoothActive(cellsTemp, smoothPasses);
+        else
+            cells.smooth(cellsTemp, smoothPasses);
+        cells.store(map, WALL, FLOOR);
+    }
     
-    return true;
+    if (stats)
+        stats->smoothPasses += run;
+    regionsValid = false;
+    version++;
 }
 
-bool DJS::connected(int first, int second) {
-    Node* f = find(v[first]);
-    Node* s = find(v[second]);
-    
-    return f->val == s->val;
+void World::setSmoothing(int passes, bool active) {
+    smoothPasses = std::max(0, passes);
+    activeSmoothing = active;
 }
 
-
-/////////////////
-// World Class //
-/////////////////
-
-/*
- Cave Build Functions
- 
- buildCave:
-     percentWall - (Default 45) Bigger number for less floor space
- */
-
-void World::buildCave() {
-    int percentWall = 46;
-    
-    //Randomly Generate Walls and Floors
-    for (int y = 1; y < size - 1; y++)
-        for (int x = 1; x < size - 1; x++)
-            if (rand() % 100 > percentWall)
-                set(x, y, FLOOR);
-    
-    //Clean it up
-    std::vector<int> temp;
-    int n;
-    
-    temp = map;
-    
-    for (int i = 0; i < 5; i++) {
-        for (int y = 1; y < size - 1; y++)
-            for (int x = 1; x < size - 1; x++) {
-                n = 0;
-                for (int yy = -1; yy <= 1; yy++)
-                    for (int xx = -1; xx <= 1; xx++)
-                        if (map[(y + yy) * size + x + xx] == WALL)
-                            n++;
-                if (n >= 5)
-                    temp[y * size + x] = WALL;
-                else
-                    temp[y * size + x] = FLOOR;
-        }
-        map = temp;
-    }
-    
-    //Remove inaccessable caverns
-    std::vector<bool> connected;
-    int spots = 0, randCoord;
+void World::cleanCave() {
+    TRACE_SCOPE("World::cleanCave");
+    StageTimer timer(stats, &GenerationStats::cleanupSeconds);
+    std::vector<size_t> &sizes = regionSizes;
     
-    while ((100 * spots) / (size * size) <= 25) {
+    labelRegions(sizes);
+    keepRegions(sizes, 0);
     
-        do {
-            randCoord = rand() % (size * (size - 2)) + size;
-        } while (map[randCoord] != FLOOR);
-    
-        connected = flood(randCoord, spots);
+    if (stats && !sizes.empty()) {
+        stats->regionsFound += sizes.size();
+        for (size_t n : sizes)
+            stats->cellsRemoved += n;
+        stats->cellsRemoved -= *std::max_element(sizes.begin(), sizes.end());
     }
-    
-    for (int i = 0; i < size * size; i++)
-        if (!connected[i])
-            set(i % size, i / size, WALL);
 }
 
 
@@ -158,298 +163,686 @@ void World::buildCave() {
  Dungeon build functions
  
  buildDungeon:
-     numOfRooms - Adjusts the maximum number of rooms the generator will try to fit in.
+     numOfRooms - Adjusts the maximum number of rooms the generator will try to fit in, none if negative.
      maxAttempts - Maximum number of tries to place a room before the generator gives up.
      roomDistanceThreshold - Minimum area between rooms
+     minRoom, maxRoom - Room side range, 0 picks one from the map area and room count (see roomLimits)
+     kruskal - Selects halls with Kruskal's algorithm instead of random draws (see kruskalHalls)
+     extraLoops - With kruskal, halls kept past the ones that connect the rooms
+ 
+ The stages can also be run one at a time, in this order, with the same params:
+     placeRooms - random rooms until numOfRooms fit or an attempt limit is hit
+     compactRooms - slides the rooms toward the center
+     findHalls - carves the rooms and lists every possible hall
+     selectHalls - picks halls until the rooms are connected and carves them,
+                   false if a room could not be connected
+ 
+ Returns false, like selectHalls, if a room was left stranded. This is counted in the stats too.
  */
 
-void World::buildDungeon() {
-    int numOfRooms = 20;
-    int maxAttempts = 2000, attempts = 0;
-    int roomDistanceThreshold = 3;
+DungeonParams::DungeonParams() : numOfRooms(20), maxAttempts(2000), roomDistanceThreshold(3), minRoom(0), maxRoom(0), kruskal(false), extraLoops(0) { }
+
+bool World::buildDungeon(const DungeonParams &params) {
+    TRACE_SCOPE("World::buildDungeon");
+    bool connected;
+    
+    if (stats)
+        stats->dungeons++;
+    
+    placeRooms(params);
+    compactRooms(params);
+    findHalls();
+    connected = selectHalls(params);
+    
+    if (stats && !connected)
+        stats->strandedRooms++;
+    
+    return connected;
+}
+
+void World::placeRooms(const DungeonParams &params) {
+    TRACE_SCOPE("World::placeRooms");
+    StageTimer timer(stats, &GenerationStats::placeSeconds);
+    int numOfRooms = std::max(0, params.numOfRooms);
+    int maxAttempts = params.maxAttempts, attempts = 0;
+    int roomDistanceThreshold = params.roomDistanceThreshold;
+    RoomLimits limits = roomLimits(params);
     rooms.clear();
+    halls.clear();
     clear();
     
+    if (MIN_ROOM_SIZE > largestRoom(width) || MIN_ROOM_SIZE > largestRoom(height))
+        return;
+    
     //Add rooms until either a time-out or number of desired rooms is reached.
+    //Every attempt has its own counter, so attempt k is the same room no matter what came before.
+    //Overlap tests go through roomGrid, which is kept up to date as rooms are placed and moved.
+    int attempt = 0;
+    
+    rooms.reserve(numOfRooms);
+    roomGrid.reset(width, height, std::max(limits.maxW, limits.maxH) + 2 * roomDistanceThreshold + 2, numOfRooms);
+    
     for (int i = 0; i < numOfRooms; i++) {
-        Room temp = Room();
+        int firstAttempt = attempt;
+        Room temp = Room(rng, attempt++, limits);
         attempts = 0;
-        while (!temp.valid(rooms, roomDistanceThreshold) && attempts++ < maxAttempts)
-            temp = Room();
+        while (!temp.valid(roomGrid, roomDistanceThreshold) && attempts++ < maxAttempts)
+            temp = Room(rng, attempt++, limits);
+        if (stats)
+            stats->mostAttempts = std::max(stats->mostAttempts, (uint64_t)(attempt - firstAttempt));
         if (attempts >= maxAttempts)
             break;
-        temp.set();
+        temp.set((int)rooms.size());
         rooms.push_back(temp);
+        roomGrid.insert(temp);
     }
     
+    if (stats) {
+        stats->roomsPlaced += rooms.size();
+        stats->placementAttempts += attempt;
+    }
+}
+
+void World::compactRooms(const DungeonParams &params) {
+    TRACE_SCOPE("World::compactRooms");
+    StageTimer timer(stats, &GenerationStats::compactSeconds);
+    int roomDistanceThreshold = params.roomDistanceThreshold;
+    
     //Sort rooms by distance to center and compact the rooms
-    int moves;
+    //Only rooms that moved in a pass can be out of order, so they are sorted and merged back in.
+    std::vector<Room> &still = roomsStill, &moved = roomsMoved;
+    bool slid;
+    
+    std::sort(rooms.begin(), rooms.end(), Room::compareXY);
+    still.reserve(rooms.size());
+    moved.reserve(rooms.size());
     
     do {
-        moves = 0;
-        std::sort(rooms.begin(), rooms.end(), Room::compareXY);
-        for (size_t i = 0; i < rooms.size(); i++)
-            while (rooms[i].moveXY(rooms, roomDistanceThreshold))
-                moves++;
-    } while (moves > 0);
-    
-    //Place Rooms
-    for (Room r : rooms)
+        still.clear();
+        moved.clear();
+        
+        for (size_t i = 0; i < rooms.size(); i++) {
+            slid = false;
+            while (rooms[i].slideXY(roomGrid, roomDistanceThreshold)) {
+                slid = true;
+                if (stats)
+                    stats->compactionMoves++;
+            }
+            (slid ? moved : still).push_back(rooms[i]);
+        }
+        
+        if (!moved.empty()) {
+            std::sort(moved.begin(), moved.end(), Room::compareXY);
+            rooms.clear();
+            std::merge(still.begin(), still.end(), moved.begin(), moved.end(), std::back_inserter(rooms), Room::compareXY);
+        }
+        
+        if (stats)
+            stats->compactionPasses++;
+    } while (!moved.empty());
+}
+
+void World::findHalls() {
+    TRACE_SCOPE("World::findHalls");
+    StageTimer timer(stats, &GenerationStats::hallFindSeconds);
+    
+    //Place Rooms, this also fills edgeOwner
+    edgeOwner.assign(map.size(), -1);
+    
+    for (const Room &r : rooms)
         placeRoom(r);
+    regionsValid = false;
+    version++;
+    
+    setPossHalls(possHalls);
+    hallIndex.reset(possHalls, width, height);
     
-    //Minimally connect the rooms
-    std::vector<Hall> possHalls;
-    DJS connSet(rooms.size());
+    if (stats)
+        stats->hallCandidates += possHalls.size();
+}
+
+bool World::selectHalls(const DungeonParams &params) {
+    TRACE_SCOPE("World::selectHalls");
+    StageTimer timer(stats, &GenerationStats::hallSelectSeconds);
+    bool connected;
+    
+    roomSets.reset(rooms.size());
+    connected = params.kruskal ? kruskalHalls(params) : randomHalls(params);
+    
+    for (const Hall &h : halls)
+        placeHall(h);
+    regionsValid = false;
+    version++;
+    
+    return connected;
+}
+
+/*
+ randomHalls:
+     Draws open candidates at random until the rooms are connected or none are left. A draw that
+     joins two unconnected rooms and is no longer than 3 * roomDistanceThreshold is kept, any
+     other is thrown out, so the number of draws is up to chance.
+ 
+ kruskalHalls:
+     Takes the candidates that are short enough in a random order, each once, and keeps a hall
+     if it is still open and joins two sets of rooms. That is Kruskal's algorithm with random
+     weights: a random order is the order random weights sort into, and shuffling it as it is
+     read costs one draw per candidate looked at instead of a sort. Every candidate is looked
+     at no more than once, so the time is bounded by the candidate count whatever the seed.
+     Once the rooms are connected, up to extraLoops more open candidates are kept. These join
+     rooms that are already connected, which gives the dungeon some loops.
+ 
+ Both close the candidates a kept hall crosses or duplicates (HallIndex::accept), and both
+ return false if a room was left stranded.
+ */
+
+bool World::randomHalls(const DungeonParams &params) {
+    int roomDistanceThreshold = params.roomDistanceThreshold;
+    DisjointSet &connSet = roomSets;
     Hall currHall;
     bool strandedRoom = false;
     int randHall;
     
-    possHalls = setPossHalls();
-    
-    do {
-        //Update possible hallways, if none, break and note the stranded room
-        possHalls = updateHalls(possHalls);
-        
-        if (possHalls.size() == 0) {
+    while (!connSet.connected()) {
+        //If no possible hallways are left, break and note the stranded room
+        if (hallIndex.size() == 0) {
             strandedRoom = true;
             break;
         }
         
-        //Randomly select a room, if it is a new connection add to the list and update the DJS
-        randHall = rand() % possHalls.size();
-        currHall = possHalls[randHall];
+        //Randomly select a hall, if it is a new connection add to the list and update the set
+        //Accepting it closes the candidates it crosses or duplicates.
+        randHall = hallIndex.at(rng.next((int)hallIndex.size()));
+        currHall = hallIndex.hall(randHall);
         
         if (!connSet.connected(currHall.rooms().first, currHall.rooms().second) && currHall.len() <= 3 * roomDistanceThreshold) {
             halls.push_back(currHall);
             connSet.merge(currHall.rooms().first, currHall.rooms().second);
+            hallIndex.accept(randHall);
+            if (stats)
+                stats->hallsAccepted++;
         } else {
-            possHalls.erase(possHalls.begin() + randHall);
+            hallIndex.remove(randHall);
+            if (stats)
+                stats->hallsRejected++;
         }
-        
-    } while (!connSet.connected());
-    
-    for (Hall h : halls)
-        placeHall(h);
-    
-    //Deal with the standed room
-    if (strandedRoom) {
-    
-        //Find a seed with a stranded room first. Case may not exist.
-        std::cout << "*****************************" << std::endl;
-        std::cout << "********STRANDED ROOM********" << std::endl;
-        std::cout << "*****************************" << std::endl;
-        
     }
+    
+    return !strandedRoom;
 }
 
-std::vector<Hall> World::setPossHalls() {
-    std::vector<std::vector<int>> temp;
-    std::vector<Hall> possibles;
-    std::set<int> edges;
-    int x, y, n, endRoom;
+bool World::kruskalHalls(const DungeonParams &params) {
+    TRACE_SCOPE("World::kruskalHalls");
+    int maxLength = 3 * params.roomDistanceThreshold;
+    int loops = 0;
+    size_t before = halls.size(), next = 0;
     
-    for (Room r : rooms)
-        for (std::vector<int> v : r.edges())
-            for (int i : v)
-                edges.insert(i);
+    hallOrder.clear();
+    hallOrder.reserve(possHalls.size());
+    for (int id = 0; id < (int)possHalls.size(); id++)
+        if (hallIndex.hall(id).len() <= maxLength)
+            hallOrder.push_back(id);
     
-    for (Room r : rooms) {
-        temp = r.edges();
+    //Spanning halls, then loops, every open candidate left joins rooms that are already connected
+    while (next < hallOrder.size() && (!roomSets.connected() || loops < params.extraLoops)) {
+        int id = nextHall(next++);
+        const Hall &hall = hallIndex.hall(id);
         
-        for (int i : temp[NORTH]) {
-            n = 0;
-            x = i % size;
-            y = i / size;
-            while (y - n - 2 > 0) {
-                n++;
-                if (map[(y - n - 1) * size + x] == FLOOR) {
-                    endRoom = getRoomByEdge((y - n) * size + x);
-                    if (edges.find((y - n) * size + x) != edges.end() && endRoom > -1)
-                        possibles.push_back(Hall(r.num(), y * size + x, endRoom, (y - n) * size + x, NORTH));
-                    break;
-                }
-            }
-        }
-        
-        for (int i : temp[EAST]) {
-            n = 0;
-            x = i % size;
-            y = i / size;
-            while (x + n + 2 < size) {
-                n++;
-                if (map[y * size + x + n + 1] == FLOOR) {
-                    endRoom = getRoomByEdge(y * size + x + n);
-                    if (edges.find(y * size + x + n) != edges.end() && endRoom > -1)
-                        possibles.push_back(Hall(r.num(), y * size + x, endRoom, y * size + x + n, EAST));
-                    break;
-                }
-            }
-        }
-        
-        for (int i : temp[SOUTH]) {
-            n = 0;
-            x = i % size;
-            y = i / size;
-            while (y + n + 2 < size) {
-                n++;
-                if (map[(y + n + 1) * size + x] == FLOOR) {
-                    endRoom = getRoomByEdge((y + n) * size + x);
-                    if (edges.find((y + n) * size + x) != edges.end() && endRoom > -1)
-                        possibles.push_back(Hall(r.num(), y * size + x, endRoom, (y + n) * size + x, SOUTH));
-                    break;
-                }
-            }
-        }
-        
-        for (int i : temp[WEST]) {
-            n = 0;
-            x = i % size;
-            y = i / size;
-            while (x - n - 2 > 0) {
-                n++;
-                if (map[y * size + x - n - 1] == FLOOR) {
-                    endRoom = getRoomByEdge(y * size + x - n);
-                    if (edges.find(y * size + x - n) != edges.end() && endRoom > -1)
-                        possibles.push_back(Hall(r.num(), y * size + x, endRoom, y * size + x - n, WEST));
-                    break;
-                }
-            }
+        if (!hallIndex.isOpen(id))
+            continue;
+        if (roomSets.merge(hall.rooms().first, hall.rooms().second) || (roomSets.connected() && loops++ < params.extraLoops)) {
+            halls.push_back(hall);
+            hallIndex.accept(id);
         }
     }
     
-    return possibles;
+    if (stats) {
+        stats->hallsAccepted += halls.size() - before;
+        stats->hallsRejected += possHalls.size() - (halls.size() - before);
+    }
+    
+    return roomSets.connected();
+}
+
+//One step of a Fisher-Yates shuffle, the candidates are only shuffled as far as they are used
+int World::nextHall(size_t i) {
+    std::swap(hallOrder[i], hallOrder[i + rng.next((int)(hallOrder.size() - i))]);
+    return hallOrder[i];
 }
 
-std::vector<Hall> World::updateHalls(std::vector<Hall> possibles) {
-    std::vector<Hall> temp;
-    bool validHall;
+
+/*
+ roomLimits:
+     Without a size from params, the average room side is picked so that numOfRooms rooms cover
+     about 60% of the map, then stretched by the map's aspect ratio. Sizes range 15% either side.
+ 
+ largestRoom:
+     Longest room side that stays on a map side of mapSide cells once compactRooms has centered
+     it. Rooms are never shorter than MIN_ROOM_SIZE, so on maps where that does not fit
+     placeRooms places none.
+ */
+
+RoomLimits World::roomLimits(const DungeonParams &params) const {
+    RoomLimits limits;
+    double side = sqrt(0.6 * width * height / std::max(1, params.numOfRooms));
+    double aspect = sqrt((double)width / height);
     
-    for (Hall p : possibles) {
-        validHall = true;
-        
-        for (Hall h : halls)
-            if (p.sameConnection(h) || p.crosses(h))
-                validHall = false;
-        
-        if (validHall)
-            temp.push_back(p);
+    limits.mapW = width;
+    limits.mapH = height;
+    
+    if (params.minRoom > 0 && params.maxRoom > params.minRoom) {
+        limits.minW = limits.minH = params.minRoom;
+        limits.maxW = limits.maxH = params.maxRoom;
+    } else {
+        limits.minW = (int)(side * aspect * 0.85);
+        limits.maxW = (int)(side * aspect * 1.15) + 1;
+        limits.minH = (int)(side / aspect * 0.85);
+        limits.maxH = (int)(side / aspect * 1.15) + 1;
     }
     
-    return temp;
+    //Rooms need a usable edge and must fit on the map
+    limits.minW = std::max(MIN_ROOM_SIZE, std::min(limits.minW, width / 2));
+    limits.maxW = std::max(limits.minW + 1, std::min(limits.maxW, width / 2 + 1));
+    limits.minH = std::max(MIN_ROOM_SIZE, std::min(limits.minH, height / 2));
+    limits.maxH = std::max(limits.minH + 1, std::min(limits.maxH, height / 2 + 1));
+    limits.maxW = std::min(limits.maxW, largestRoom(width) + 1);
+    limits.maxH = std::min(limits.maxH, largestRoom(height) + 1);
+    
+    return limits;
 }
 
-int World::getRoomByEdge(int coord) {
+int World::largestRoom(int mapSide) {
+    //A centered room spans mapSide / 2 - side / 2 to that plus side, inclusive
+    return 2 * ((mapSide + 1) / 2 - 1);
+}
+
+/*
+ setPossHalls:
+     Walks out from every edge cell of every room until it reaches FLOOR. If the cell just before
+     the FLOOR is another room's edge, the walk is a possible Hall. Edge cells are looked up in
+     edgeOwner, so no edge lists are built. Every edge cell starts at most one walk, so the
+     rooms' perimeters bound the list and it is reserved once up front.
+ */
+
+void World::setPossHalls(std::vector<Hall> &possibles) {
+    TRACE_SCOPE("World::setPossHalls");
+    const int dx[4] = {0, 1, 0, -1};
+    const int dy[4] = {-1, 0, 1, 0};
+    int x1, y1, x2, y2, x, y, n, endRoom;
+    size_t edgeCells = 0;
     
-    for (Room r : rooms)
-        for (std::vector<int> v : r.edges())
-            for (int i : v)
-                if (coord == i)
-                    return r.num();
+    possibles.clear();
+    for (const Room &r : rooms)
+        edgeCells += 2 * (r.dim().first + r.dim().second + 2);
+    possibles.reserve(edgeCells);
     
-    return -1;
+    for (const Room &r : rooms) {
+        for (int dir = NORTH; dir <= WEST; dir++) {
+            r.edge(dir, x1, y1, x2, y2);
+            
+            for (int i = 0; i <= x2 - x1 + y2 - y1; i++) {
+                x = x1 + (x1 < x2 ? i : 0);
+                y = y1 + (y1 < y2 ? i : 0);
+                
+                //Longest walk before reaching the map border
+                int reach = dir == NORTH ? y - 2 : dir == EAST ? width - x - 2 : dir == SOUTH ? height - y - 2 : x - 2;
+                
+                for (n = 1; n <= reach; n++) {
+                    if (map[index(x + dx[dir] * (n + 1), y + dy[dir] * (n + 1))] == FLOOR) {
+                        endRoom = getRoomByEdge(index(x + dx[dir] * n, y + dy[dir] * n));
+                        if (endRoom > -1)
+                            possibles.push_back(Hall(r.num(), x, y, endRoom, x + dx[dir] * n, y + dy[dir] * n, dir));
+                        break;
+                    }
+                }
+            }
+        }
+    }
+}
+
+int World::getRoomByEdge(size_t coord) const {
+    return edgeOwner[coord];
 }
 
-void World::placeRoom(Room r) {
+/*
+ placeRoom:
+     Clears the room's floor and records which room owns each of its edge cells. Like placeHall it
+     writes the map directly, the caller marks the map changed once for the whole layout.
+ */
+
+void World::placeRoom(const Room &r) {
+    int x1, y1, x2, y2;
+    
     for (int y = r.coords().second + 1; y < r.coords().second + r.dim().second; y++)
         for (int x = r.coords().first + 1; x < r.coords().first + r.dim().first; x++)
-                set(x, y, FLOOR);
+                map[index(x, y)] = FLOOR;
+    
+    for (int dir = NORTH; dir <= WEST; dir++) {
+        r.edge(dir, x1, y1, x2, y2);
+        for (int y = y1; y <= y2; y++)
+            for (int x = x1; x <= x2; x++)
+                edgeOwner[index(x, y)] = r.num();
+    }
 }
 
-void World::placeHall(Hall h) {
-    int x1 = h.coords().first % size;
-    int x2 = h.coords().second % size;
-    int y1 = h.coords().first / size;
-    int y2 = h.coords().second / size;
+void World::placeHall(const Hall &h) {
+    int x1 = h.startPoint().first;
+    int x2 = h.endPoint().first;
+    int y1 = h.startPoint().second;
+    int y2 = h.endPoint().second;
     switch (h.dir()) {
         case EAST:
             for (int x = x1 + 1; x < x2; x++)
-                set(x, y1, FLOOR);
+                map[index(x, y1)] = FLOOR;
             break;
             
         case SOUTH:
             for (int y = y1 + 1; y < y2; y++)
-                set(x1, y, FLOOR);
+                map[index(x1, y)] = FLOOR;
             break;
     }
-    set(x1, y1, DOOR);
-    set(x2, y2, DOOR);
+    map[index(x1, y1)] = DOOR;
+    map[index(x2, y2)] = DOOR;
+}
+
+
+/*
+ Saving and loading, see WorldFile.hpp for the format
+ 
+ save:
+     Writes the tiles, rooms and halls. False if the file could not be written.
+ 
+ load:
+     Replaces this world with the one in the file and reseeds with its seed. False, leaving the
+     world unchanged, if the file is missing or not a world file this version can read.
+     Servers that only need to look at a level can use MappedWorld instead, which skips the copy.
+ */
+
+bool World::save(const char *path) const {
+    WorldFileHeader header;
+    std::vector<RoomRecord> roomRecords(rooms.size());
+    std::vector<HallRecord> hallRecords(halls.size());
+    const char pad[8] = {0};
+    bool ok;
+    
+    initWorldFileHeader(header, width, height, rng.getSeed(), (uint32_t)rooms.size(), (uint32_t)halls.size());
+    
+    for (size_t i = 0; i < rooms.size(); i++) {
+        const Room &r = rooms[i];
+        roomRecords[i] = {r.coords().first, r.coords().second, r.dim().first, r.dim().second, r.num()};
+    }
+    for (size_t i = 0; i < halls.size(); i++) {
+        const Hall &h = halls[i];
+        hallRecords[i] = {h.rooms().first, h.rooms().second, h.dir(),
+            h.startPoint().first, h.startPoint().second, h.endPoint().first, h.endPoint().second};
+    }
+    
+    FILE *file = fopen(path, "wb");
+    if (!file)
+        return false;
+    
+    ok = fwrite(&header, sizeof(header), 1, file) == 1
+        && fwrite(map.data(), 1, map.size(), file) == map.size()
+        && fwrite(pad, 1, header.roomsOffset - header.tilesOffset - map.size(), file) == header.roomsOffset - header.tilesOffset - map.size()
+        && fwrite(roomRecords.data(), sizeof(RoomRecord), roomRecords.size(), file) == roomRecords.size()
+        && fwrite(pad, 1, header.hallsOffset - header.roomsOffset - roomRecords.size() * sizeof(RoomRecord), file)
+            == header.hallsOffset - header.roomsOffset - roomRecords.size() * sizeof(RoomRecord)
+        && fwrite(hallRecords.data(), sizeof(HallRecord), hallRecords.size(), file) == hallRecords.size();
+    
+    return fclose(file) == 0 && ok;
+}
+
+bool World::load(const char *path) {
+    MappedWorld file;
+    
+    if (!file.open(path))
+        return false;
+    
+    width = file.getWidth();
+    height = file.getHeight();
+    rng.seed(file.getSeed());
+    map.assign(file.tiles(), file.tiles() + (size_t)width * height);
+    regionsValid = false;
+    version++;
+    
+    rooms.clear();
+    for (size_t i = 0; i < file.roomCount(); i++) {
+        const RoomRecord &r = file.room(i);
+        rooms.push_back(Room(r.x, r.y, r.w, r.h, r.id, width, height));
+    }
+    
+    halls.clear();
+    for (size_t i = 0; i < file.hallCount(); i++) {
+        const HallRecord &h = file.hall(i);
+        halls.push_back(Hall(h.start, h.sx, h.sy, h.end, h.ex, h.ey, h.dir));
+    }
+    
+    return true;
+}
+
+
+/*
+ Generation stats
+ 
+ collectStats:
+     Counters and stage times go to s from now on, NULL (the default) turns them off.
+     Turned off, each counter costs one pointer test and no clock is read.
+ */
+
+GenerationStats::GenerationStats() {
+    reset();
+}
+
+void GenerationStats::reset() {
+    caves = dungeons = 0;
+    fillSeconds = smoothSeconds = cleanupSeconds = 0;
+    placeSeconds = compactSeconds = hallFindSeconds = hallSelectSeconds = 0;
+    smoothPasses = 0;
+    regionsFound = cellsRemoved = 0;
+    roomsPlaced = placementAttempts = mostAttempts = 0;
+    compactionPasses = compactionMoves = 0;
+    hallCandidates = hallsAccepted = hallsRejected = 0;
+    strandedRooms = 0;
+}
+
+GenerationStats &GenerationStats::operator+=(const GenerationStats &other) {
+    caves += other.caves;
+    dungeons += other.dungeons;
+    fillSeconds += other.fillSeconds;
+    smoothSeconds += other.smoothSeconds;
+    cleanupSeconds += other.cleanupSeconds;
+    placeSeconds += other.placeSeconds;
+    compactSeconds += other.compactSeconds;
+    hallFindSeconds += other.hallFindSeconds;
+    hallSelectSeconds += other.hallSelectSeconds;
+    smoothPasses += other.smoothPasses;
+    regionsFound += other.regionsFound;
+    cellsRemoved += other.cellsRemoved;
+    roomsPlaced += other.roomsPlaced;
+    placementAttempts += other.placementAttempts;
+    mostAttempts = std::max(mostAttempts, other.mostAttempts);
+    compactionPasses += other.compactionPasses;
+    compactionMoves += other.compactionMoves;
+    hallCandidates += other.hallCandidates;
+    hallsAccepted += other.hallsAccepted;
+    hallsRejected += other.hallsRejected;
+    strandedRooms += other.strandedRooms;
+    return *this;
+}
+
+void World::collectStats(GenerationStats *s) {
+    stats = s;
 }
 
 
 /*
  Constructor, misc helper functions, and overrides
+ Width and height are fixed per World, cells are indexed with 64 bits (see index). Sides below
+ MIN_MAP_SIZE are raised to it, a map needs a wall border around at least one cell.
+ getVersion changes whenever a tile does, so anything derived from the map can tell it is stale
+ getRooms, getHalls - the layout from the last buildDungeon (or load), empty after buildCave
  */
 
-World::World() {
-    size = DEFAULT_MAP_SIZE;
+World::World(uint64_t seed) : rng(seed), stats(NULL), smoothPasses(DEFAULT_SMOOTH_PASSES), activeSmoothing(false), version(0), width(0), height(0), regionsValid(false) {
+    resize(DEFAULT_MAP_SIZE, DEFAULT_MAP_SIZE);
+}
+
+World::World(int width, int height, uint64_t seed) : rng(seed), stats(NULL), smoothPasses(DEFAULT_SMOOTH_PASSES), activeSmoothing(false), version(0), width(0), height(0), regionsValid(false) {
+    resize(width, height);
+}
+
+void World::seed(uint64_t s) {
+    rng.seed(s);
+}
+
+void World::resize(int w, int h) {
+    width = std::max(MIN_MAP_SIZE, w);
+    height = std::max(MIN_MAP_SIZE, h);
+    rooms.clear();
+    halls.clear();
     clear();
 }
 
 void World::clear() {
-    map.clear();
-    for (int i = 0; i < size * size; i++)
-        map.push_back(WALL);
+    map.assign((size_t)width * height, WALL);
+    regionsValid = false;
+    version++;
+}
+
+size_t World::index(int x, int y) const {
+    return (size_t)y * width + x;
 }
 
 void World::set(int x, int y, int val) {
-    map[y * size + x] = val;
+    map[index(x, y)] = val;
+    regionsValid = false;
+    version++;
 }
 
 void World::swap(int x1, int y1, int x2, int y2) {
-    int temp = map[y2 * size + x2];
-    map[y2 * size + x2] = map[y1 * size + x1];
-    map[y1 * size + x1] = temp;
+    Tile temp = map[index(x2, y2)];
+    map[index(x2, y2)] = map[index(x1, y1)];
+    map[index(x1, y1)] = temp;
+    regionsValid = false;
+    version++;
+}
+
+int World::getWidth() const {
+    return width;
+}
+
+int World::getHeight() const {
+    return height;
+}
+
+uint64_t World::getVersion() const {
+    return version;
+}
+
+const std::vector<Room> &World::getRooms() const {
+    return rooms;
+}
+
+const std::vector<Hall> &World::getHalls() const {
+    return halls;
+}
+
+const Tile *World::tiles() const {
+    return map.data();
 }
 
 std::ostream &operator<<(std::ostream &out, const World &w) {
-    for (int y = 0; y < w.size; y++) {
-        for (int x = 0; x < w.size; x++) {
-            switch (w.map[y * w.size + x]) {
-                case 0:
-                    out << ' ';
-                    break;
-                case 1:
-                    out << '#';
-                    break;
-                case 2:
-                    out << 'D';
-                    break;
-            }
-        }
-        out << '\n';
-    }
+    Renderer r(Renderer::ASCII);
+    r.render(w);
+    r.write(out);
     return out;
 }
 
-std::vector<bool> World::flood(int coord, int &c) {
-    std::vector<bool> visited(size * size, false), connected(size * size, false);
-    std::stack<int> stack;
-    int next;
+
+/*
+ Region labeling
+ 
+ labelRegions:
+     Labels every 4-connected open (not WALL) region in one sweep, regions[i] is the label of
+     cell i or -1. Fills sizes with the cell count of each label and returns the number of regions.
+ 
+     First pass merges each open cell with its west and north neighbors in cellSets. The second
+     pass gives each set's root a label the first time one of its cells is reached.
+ 
+ keepRegions:
+     Walls in every region smaller than minCells, or every region but the largest if minCells is 0.
+ 
+ reachable:
+     True if a walk over open cells joins the two points. Labels are rebuilt only after the map
+     changes, so repeated queries are O(1).
+ 
+ regionCount:
+     Labels the map afresh and returns the number of open regions, a cleaned cave should have one.
+     The labels keepRegions leaves behind are not reused, so this also checks cleanCave itself.
+ */
+
+int World::labelRegions(std::vector<size_t> &sizes) {
+    TRACE_SCOPE("World::labelRegions");
+    int64_t root;
     
-    c = 0;
+    cellSets.reset(map.size());
+    regions.assign(map.size(), -1);
+    sizes.clear();
     
-    stack.push(coord);
+    for (size_t i = 0; i < map.size(); i++) {
+        if (map[i] == WALL)
+            continue;
+        if (i % width > 0 && map[i - 1] != WALL)
+            cellSets.merge(i, i - 1);
+        if (i >= (size_t)width && map[i - width] != WALL)
+            cellSets.merge(i, i - width);
+    }
     
-    while (!stack.empty()) {
-        next = stack.top();
-        stack.pop();
-        
-        c++;
-        visited[next] = true;
-        connected[next] = true;
+    for (size_t i = 0; i < map.size(); i++) {
+        if (map[i] == WALL)
+            continue;
         
-        if (!visited[next - size] && map[next - size] == FLOOR)
-            stack.push(next - size);
-        if (!visited[next + 1] && map[next + 1] == FLOOR)
-            stack.push(next + 1);
-        if (!visited[next + size] && map[next + size] == FLOOR)
-            stack.push(next + size);
-        if (!visited[next - 1] && map[next - 1] == FLOOR)
-            stack.push(next - 1);
+        root = cellSets.find(i);
+        if (regions[root] < 0) {
+            regions[root] = (int64_t)sizes.size();
+            sizes.push_back(0);
+        }
         
+        regions[i] = regions[root];
+        sizes[regions[i]]++;
     }
     
-    return connected;
+    regionsValid = true;
+    return (int)sizes.size();
+}
+
+void World::keepRegions(const std::vector<size_t> &sizes, size_t minCells) {
+    TRACE_SCOPE("World::keepRegions");
+    int64_t largest = -1;
+    
+    if (minCells == 0 && !sizes.empty())
+        largest = std::max_element(sizes.begin(), sizes.end()) - sizes.begin();
+    
+    for (size_t i = 0; i < map.size(); i++) {
+        if (regions[i] < 0)
+            continue;
+        if (minCells == 0 ? regions[i] != largest : sizes[regions[i]] < minCells) {
+            map[i] = WALL;
+            regions[i] = -1;
+        }
+    }
+    version++;
+}
+
+bool World::reachable(int x1, int y1, int x2, int y2) {
+    if (!regionsValid)
+        labelRegions(regionSizes);
+    
+    return regions[index(x1, y1)] >= 0 && regions[index(x1, y1)] == regions[index(x2, y2)];
+}
+
+int World::regionCount() {
+    return labelRegions(regionSizes);
 }
 
 
@@ -459,32 +852,38 @@ std::vector<bool> World::flood(int coord, int &c) {
 
 /*
  Constructor - builds a random room
+ rng - the owning World's generator
+ attempt - counter for this placement attempt, the room only depends on (seed, attempt)
+ limits - map size and room size range from the owning World
+ 
+ The second constructor rebuilds a saved room as is.
  */
 
-int Room::count = 0;
-int Room::size = DEFAULT_MAP_SIZE;
+Room::Room() : x(0), y(0), w(0), h(0), id(-1), mapW(0), mapH(0) { }
 
-Room::Room() {
-    int maxV = (2 * (size / 10)) / 4;
-    int maxS = (2 * (size / 10)) - maxV;
-    w = rand() % maxV + maxS;
-    h = rand() % maxV + maxS;
-    x = rand() % (size - w);
-    y = rand() % (size - h);
-    id = -1;
+Room::Room(Random &rng, int attempt, const RoomLimits &limits) : id(-1), mapW(limits.mapW), mapH(limits.mapH) {
+    uint32_t r[4];
+    rng.block(STREAM_ROOMS, attempt, r);
+    w = Random::range(r[0], limits.maxW - limits.minW) + limits.minW;
+    h = Random::range(r[1], limits.maxH - limits.minH) + limits.minH;
+    x = Random::range(r[2], mapW - w);
+    y = Random::range(r[3], mapH - h);
 }
 
-void Room::set() {
+Room::Room(int _x, int _y, int _w, int _h, int num, int _mapW, int _mapH) : x(_x), y(_y), w(_w), h(_h), id(num), mapW(_mapW), mapH(_mapH) { }
+
+void Room::set(int num) {
     if (id < 0)
-        id = count++;
+        id = num;
 }
 
 
 /*
  Validation, used to check for overlaps and valid moves. Can add an offset.
+ The RoomGrid versions only test rooms whose rectangles reach the area the check covers.
  */
 
-bool Room::valid(Room other, int offset) {
+bool Room::valid(const Room &other, int offset) const {
     if (equals(other))
         return false;
     
@@ -500,107 +899,131 @@ bool Room::valid(Room other, int offset) {
     return ((lx2 > rx1 + offset || rx2 < lx1 - offset) || (uy2 > ly1 + offset || ly2 < uy1 - offset));
 }
 
-bool Room::valid(std::vector<Room> &others, int offset) {
-    for (Room r : others)
-        if (num() != r.num() && !valid(r, offset))
-            return false;
-    return true;
+bool Room::valid(const RoomGrid &others, int offset) const {
+    return !others.any(x - offset, y - offset, x + w + offset, y + h + offset, [&](const Room &r) {
+        return num() != r.num() && !valid(r, offset);
+    });
 }
 
-bool Room::validX(Room other, int offset) {
+bool Room::validX(const Room &other, int offset) const {
     if (other.y > y + h || other.y + other.h < y)
         return true;
     return (other.x > x + w + offset || other.x + other.w < x - offset);
 }
 
-bool Room::validX(std::vector<Room> &others, int offset) {
-    for (Room r : others)
-        if (num() != r.num() && !validX(r, offset))
-            return false;
-    return true;
+bool Room::validX(const RoomGrid &others, int offset) const {
+    return !others.any(x - offset, y, x + w + offset, y + h, [&](const Room &r) {
+        return num() != r.num() && !validX(r, offset);
+    });
 }
 
-bool Room::validY(Room other, int offset) {
+bool Room::validY(const Room &other, int offset) const {
     if (other.x > x + w || other.x + other.w < x)
         return true;
     return (other.y > y + h + offset || other.y + other.h < y - offset);
 }
 
-bool Room::validY(std::vector<Room> &others, int offset) {
-    for (Room r : others)
-        if (num() != r.num() && !validY(r, offset))
-            return false;
-    return true;
+bool Room::validY(const RoomGrid &others, int offset) const {
+    return !others.any(x, y - offset, x + w, y + h + offset, [&](const Room &r) {
+        return num() != r.num() && !validY(r, offset);
+    });
 }
 
-bool Room::equals(Room other) {
+bool Room::equals(const Room &other) const {
     return (x == other.x) && (y == other.y) && (w == other.w) && (h == other.h);
 }
 
 
 /*
- edges -
- Returns a vector of room edges in a NORTH, EAST, SOUTH, WEST order vector to find possible Halls
+ edge -
+ Sets (x1, y1) to (x2, y2), the usable cells of the NORTH, EAST, SOUTH or WEST wall for Halls.
+ Corners and the cells next to them are left out. Empty when x1 > x2 or y1 > y2.
  */
 
-std::vector<std::vector<int>> Room::edges() {
-    std::vector<std::vector<int>> edges;
-    std::vector<int> no, ea, so, we;
-    
-    for (int xx = x + 2; xx < x + w - 1; xx++)
-        no.push_back(y * size + xx);
-    
-    for (int yy = y + 2; yy < y + h - 1; yy++)
-        ea.push_back(yy * size + x + w);
-    
-    for (int xx = x + 2; xx < x + w - 1; xx++)
-        so.push_back((y + h) * size + xx);
-    
-    for (int yy = y + 2; yy < y + h - 1; yy++)
-        we.push_back(yy * size + x);
-    
-    edges.push_back(no);
-    edges.push_back(ea);
-    edges.push_back(so);
-    edges.push_back(we);
-    
-    return edges;
+void Room::edge(int dir, int &x1, int &y1, int &x2, int &y2) const {
+    switch (dir) {
+        case NORTH:
+        case SOUTH:
+            x1 = x + 2;
+            x2 = x + w - 2;
+            y1 = y2 = dir == NORTH ? y : y + h;
+            break;
+            
+        default:
+            y1 = y + 2;
+            y2 = y + h - 2;
+            x1 = x2 = dir == WEST ? x : x + w;
+            break;
+    }
 }
 
 
 /*
  Move functions
+ 
+ slideX, slideY:
+     Slide the room toward the center of the map in one step and return the distance moved.
+     A room may move while validX/validY holds at offset + 1, so it stops either lined up with the
+     center or with offset + 1 cells between it and the nearest room in its way. That room is
+     found with one grid query over the strip the room would sweep through.
+ 
+ slideXY:
+     One slide on each axis, true if the room moved.
  */
 
-bool Room::moveXY(std::vector<Room> &others, int offset) {
-    bool mx = moveX(others, offset), my = moveY(others, offset);
+bool Room::slideXY(RoomGrid &others, int offset) {
+    int mx = slideX(others, offset), my = slideY(others, offset);
+    if (mx || my)
+        others.update(*this);
     return mx || my;
 }
 
-bool Room::moveX(std::vector<Room> &others, int offset) {
-    if (validX(others, offset + 1)) {
-        if ((2 * x + w) / 2 > size / 2)
-            x--;
-        else if ((2 * x + w) / 2 < size / 2)
-            x++;
-        else
-            return false;
-        return true;
+int Room::slideX(const RoomGrid &others, int offset) {
+    int center = x + w / 2, target = mapW / 2, newX, old = x;
+    
+    if (center == target || !validX(others, offset + 1))
+        return 0;
+    
+    if (center > target) {
+        newX = x - (center - target);
+        others.each(newX - offset - 1, y, x - offset - 2, y + h, [&](const Room &r) {
+            if (r.num() != num() && !(r.y > y + h || r.y + r.h < y) && r.x + r.w < x - offset - 1)
+                newX = std::max(newX, r.x + r.w + offset + 1);
+        });
+    } else {
+        newX = x + (target - center);
+        others.each(x + w + offset + 2, y, newX + w + offset + 1, y + h, [&](const Room &r) {
+            if (r.num() != num() && !(r.y > y + h || r.y + r.h < y) && r.x > x + w + offset + 1)
+                newX = std::min(newX, r.x - w - offset - 1);
+        });
     }
-    return false;
+    
+    x = newX;
+    return abs(x - old);
 }
 
-bool Room::moveY(std::vector<Room> &others, int offset) {
-    if (validY(others, offset + 1)) {
-        if ((2 * y + h) / 2 > size / 2)
-            y--;
-        else if ((2 * y + h) / 2 < size / 2)
-            y++;
-        else
-            return false;
-        return true;
+int Room::slideY(const RoomGrid &others, int offset) {
+    int center = y + h / 2, target = mapH / 2, newY, old = y;
+    
+    if (center == target || !validY(others, offset + 1))
+        return 0;
+    
+    if (center > target) {
+        newY = y - (center - target);
+        others.each(x, newY - offset - 1, x + w, y - offset - 2, [&](const Room &r) {
+            if (r.num() != num() && !(r.x > x + w || r.x + r.w < x) && r.y + r.h < y - offset - 1)
+                newY = std::max(newY, r.y + r.h + offset + 1);
+        });
+    } else {
+        newY = y + (target - center);
+        others.each(x, y + h + offset + 2, x + w, newY + h + offset + 1, [&](const Room &r) {
+            if (r.num() != num() && !(r.x > x + w || r.x + r.w < x) && r.y > y + h + offset + 1)
+                newY = std::min(newY, r.y - h - offset - 1);
+        });
     }
-    return false;
+    
+    y = newY;
+    return abs(y - old);
 }
 
 
@@ -608,13 +1031,15 @@ bool Room::moveY(std::vector<Room> &others, int offset) {
  Compare for sorting
  */
 
-bool Room::compareXY(Room i, Room j) {
+bool Room::compareXY(const Room &i, const Room &j) {
     int ix = (2 * i.x + i.w) / 2;
     int iy = (2 * i.y + i.h) / 2;
     int jx = (2 * j.x + j.w) / 2;
     int jy = (2 * j.y + j.h) / 2;
-    int iDist = ((ix - (i.size / 2)) * (ix - (i.size / 2)) + (iy - (i.size / 2)) * (iy - (i.size / 2)));
-    int jDist = ((jx - (j.size / 2)) * (jx - (j.size / 2)) + (jy - (j.size / 2)) * (jy - (j.size / 2)));
+    int64_t idx = ix - i.mapW / 2, idy = iy - i.mapH / 2;
+    int64_t jdx = jx - j.mapW / 2, jdy = jy - j.mapH / 2;
+    int64_t iDist = idx * idx + idy * idy;
+    int64_t jDist = jdx * jdx + jdy * jdy;
     return iDist < jDist;
 }
 
@@ -623,19 +1048,108 @@ bool Room::compareXY(Room i, Room j) {
  Value retrevial
  */
 
-int Room::num() {
+int Room::num() const {
     return id;
 }
 
-std::pair<int, int> Room::coords() {
+std::pair<int, int> Room::coords() const {
     return std::pair<int, int>(x, y);
 }
 
-std::pair<int, int> Room::dim() {
+std::pair<int, int> Room::dim() const {
     return std::pair<int, int>(w, h);
 }
 
 
+/////////////////////
+// Room Grid Class //
+/////////////////////
+
+RoomGrid::RoomGrid() : freeEntry(-1), cols(0), rows(0), cell(1) { }
+
+void RoomGrid::reset(int mapW, int mapH, int cellSize, size_t rooms) {
+    cell = std::max(1, cellSize);
+    cols = (mapW + cell) / cell;
+    rows = (mapH + cell) / cell;
+    
+    //Vectors keep their capacity, a room takes at most four entries
+    heads.assign((size_t)cols * rows, -1);
+    entries.clear();
+    entries.reserve(4 * rooms);
+    placed.clear();
+    placed.reserve(rooms);
+    freeEntry = -1;
+}
+
+void RoomGrid::bucketRange(const Room &r, int &bx1, int &by1, int &bx2, int &by2) const {
+    bx1 = std::max(0, r.coords().first / cell);
+    by1 = std::max(0, r.coords().second / cell);
+    bx2 = std::min(cols - 1, (r.coords().first + r.dim().first) / cell);
+    by2 = std::min(rows - 1, (r.coords().second + r.dim().second) / cell);
+}
+
+//Entries go on the end of the list, so rooms come back in the order they were listed
+void RoomGrid::link(int bucket, int id) {
+    int e = freeEntry, *tail = &heads[bucket];
+    
+    if (e >= 0)
+        freeEntry = entries[e].next;
+    else {
+        e = (int)entries.size();
+        entries.push_back(Entry());
+    }
+    entries[e].id = id;
+    entries[e].next = -1;
+    
+    while (*tail >= 0)
+        tail = &entries[*tail].next;
+    *tail = e;
+}
+
+void RoomGrid::unlink(int bucket, int id) {
+    int *prev = &heads[bucket];
+    
+    while (entries[*prev].id != id)
+        prev = &entries[*prev].next;
+    
+    int e = *prev;
+    *prev = entries[e].next;
+    entries[e].next = freeEntry;
+    freeEntry = e;
+}
+
+void RoomGrid::insert(const Room &r) {
+    int bx1, by1, bx2, by2;
+    
+    if ((size_t)r.num() >= placed.size())
+        placed.resize(r.num() + 1);
+    placed[r.num()] = r;
+    
+    bucketRange(r, bx1, by1, bx2, by2);
+    for (int by = by1; by <= by2; by++)
+        for (int bx = bx1; bx <= bx2; bx++)
+            link(by * cols + bx, r.num());
+}
+
+void RoomGrid::update(const Room &r) {
+    int ox1, oy1, ox2, oy2, nx1, ny1, nx2, ny2;
+    
+    bucketRange(placed[r.num()], ox1, oy1, ox2, oy2);
+    bucketRange(r, nx1, ny1, nx2, ny2);
+    placed[r.num()] = r;
+    
+    if (ox1 == nx1 && oy1 == ny1 && ox2 == nx2 && oy2 == ny2)
+        return;
+    
+    for (int by = oy1; by <= oy2; by++)
+        for (int bx = ox1; bx <= ox2; bx++)
+            unlink(by * cols + bx, r.num());
+    for (int by = ny1; by <= ny2; by++)
+        for (int bx = nx1; bx <= nx2; bx++)
+            link(by * cols + bx, r.num());
+}
+
+
 ////////////////
 // Hall Class //
 ////////////////
@@ -643,18 +1157,16 @@ std::pair<int, int> Room::dim() {
 /*
  Constructor:
  s - start room
- sxy - y * size + x, (x,y) coords of starting point
+ sx, sy - coords of starting point
  e - end room
- exy - y * size + x, (x,y) coords of ending point
- will adjust so sxy < exy to limit duplicate halls
+ ex, ey - coords of ending point
+ will adjust so the start comes first in row order to limit duplicate halls
  */
 
-int Hall::size = DEFAULT_MAP_SIZE;
-
-Hall::Hall(int s, int sxy, int e, int exy, int d) : start(s), startxy(sxy), end(e), endxy(exy), direction(d) {
-    if (sxy > exy) {
-        startxy = exy;
-        endxy = sxy;
+Hall::Hall(int s, int _sx, int _sy, int e, int _ex, int _ey, int d) : start(s), end(e), direction(d), sx(_sx), sy(_sy), ex(_ex), ey(_ey) {
+    if (sy > ey || (sy == ey && sx > ex)) {
+        std::swap(sx, ex);
+        std::swap(sy, ey);
         start = e;
         end = s;
         if (d == NORTH)
@@ -664,39 +1176,39 @@ Hall::Hall(int s, int sxy, int e, int exy, int d) : start(s), startxy(sxy), end(
     }
     
     if (direction == SOUTH)
-        length = (endxy / size) - (startxy / size);
+        length = ey - sy;
     else
-        length = (endxy % size) - (startxy % size);
+        length = ex - sx;
 };
 
-Hall::Hall() : start(-1), startxy(-1), end(-1), endxy(-1), direction(-1), length(-1) { }
+Hall::Hall() : start(-1), end(-1), direction(-1), length(-1), sx(-1), sy(-1), ex(-1), ey(-1) { }
 
 
 /*
  Comparison functions
  */
 
-bool Hall::equals(Hall other) {
-    return (startxy == other.startxy) && (endxy == other.endxy);
+bool Hall::equals(const Hall &other) const {
+    return (sx == other.sx) && (sy == other.sy) && (ex == other.ex) && (ey == other.ey);
 }
 
-bool Hall::sameConnection(Hall other) {
+bool Hall::sameConnection(const Hall &other) const {
     return (start == other.start) && (end == other.end);
 }
 
-bool Hall::crosses(Hall other) {
+bool Hall::crosses(const Hall &other) const {
     if (equals(other))
         return true;
     
-    int ax1 = startxy % size;
-    int ax2 = endxy % size;
-    int ay1 = startxy / size;
-    int ay2 = endxy / size;
+    int ax1 = sx;
+    int ax2 = ex;
+    int ay1 = sy;
+    int ay2 = ey;
     
-    int bx1 = other.startxy % size;
-    int bx2 = other.endxy % size;
-    int by1 = other.startxy / size;
-    int by2 = other.endxy / size;
+    int bx1 = other.sx;
+    int bx2 = other.ex;
+    int by1 = other.sy;
+    int by2 = other.ey;
     
     if (ax1 == ax2 && by1 == by2 && ax1 >= bx1 && ax1 <= bx2 && by1 >= ay1 && by1 <= ay2)
         return true;
@@ -711,19 +1223,140 @@ bool Hall::crosses(Hall other) {
  Value retrevial
  */
 
-int Hall::len() {
+int Hall::len() const {
     return length;
 }
 
-std::pair<int, int> Hall::rooms() {
+std::pair<int, int> Hall::rooms() const {
     return std::pair<int, int>(start, end);
 }
 
-std::pair<int, int> Hall::coords() {
-    return std::pair<int, int>(startxy, endxy);
+std::pair<int, int> Hall::startPoint() const {
+    return std::pair<int, int>(sx, sy);
+}
+
+std::pair<int, int> Hall::endPoint() const {
+    return std::pair<int, int>(ex, ey);
 }
 
-int Hall::dir() {
+int Hall::dir() const {
     return direction;
 }
 
+
+//////////////////////
+// Hall Index Class //
+//////////////////////
+
+/*
+ reset:
+     Rows and columns are stored as one flat array each (counting sort by line), and room pairs
+     are grouped by sorting, so a reused index needs no allocations.
+ */
+
+uint64_t HallIndex::pairKey(const Hall &h) {
+    return ((uint64_t)(uint32_t)h.rooms().first << 32) | (uint32_t)h.rooms().second;
+}
+
+void HallIndex::bucket(const std::vector<Hall> &halls, int dir, int lines, std::vector<int> &start, std::vector<int> &ids) {
+    start.assign(lines + 2, 0);
+    
+    for (const Hall &h : halls)
+        if (h.dir() == dir)
+            start[(dir == EAST ? h.startPoint().second : h.startPoint().first) + 2]++;
+    for (int i = 2; i < lines + 2; i++)
+        start[i] += start[i - 1];
+    
+    ids.resize(start[lines + 1]);
+    for (int id = 0; id < (int)halls.size(); id++)
+        if (halls[id].dir() == dir)
+            ids[start[(dir == EAST ? halls[id].startPoint().second : halls[id].startPoint().first) + 1]++] = id;
+}
+
+void HallIndex::reset(const std::vector<Hall> &candidates, int mapW, int mapH) {
+    TRACE_SCOPE("HallIndex::reset");
+    halls = candidates;
+    open.resize(halls.size());
+    pos.resize(halls.size());
+    for (int id = 0; id < (int)halls.size(); id++)
+        open[id] = pos[id] = id;
+    
+    bucket(halls, EAST, mapH, rowStart, rowIds);
+    bucket(halls, SOUTH, mapW, colStart, colIds);
+    
+    //Group candidates by room pair, pairIds holds each group contiguously and in id order,
+    //pairGroup is the range of a candidate's group in pairIds
+    pairIds.resize(halls.size());
+    for (int id = 0; id < (int)halls.size(); id++)
+        pairIds[id] = id;
+    std::sort(pairIds.begin(), pairIds.end(), [&](int a, int b) {
+        uint64_t ka = pairKey(halls[a]), kb = pairKey(halls[b]);
+        return ka < kb || (ka == kb && a < b);
+    });
+    
+    pairGroup.resize(halls.size());
+    for (size_t first = 0, end; first < pairIds.size(); first = end) {
+        uint64_t key = pairKey(halls[pairIds[first]]);
+        for (end = first + 1; end < pairIds.size() && pairKey(halls[pairIds[end]]) == key; end++);
+        for (size_t i = first; i < end; i++)
+            pairGroup[pairIds[i]] = std::make_pair((int)first, (int)end);
+    }
+}
+
+bool HallIndex::isOpen(int id) const {
+    return pos[id] >= 0;
+}
+
+size_t HallIndex::size() const {
+    return open.size();
+}
+
+int HallIndex::at(size_t i) const {
+    return open[i];
+}
+
+const Hall &HallIndex::hall(int id) const {
+    return halls[id];
+}
+
+void HallIndex::remove(int id) {
+    if (pos[id] < 0)
+        return;
+    
+    int last = open.back();
+    open[pos[id]] = last;
+    pos[last] = pos[id];
+    open.pop_back();
+    pos[id] = -1;
+}
+
+void HallIndex::accept(int id) {
+    TRACE_SCOPE("HallIndex::accept");
+    const Hall h = halls[id];
+    int x1 = h.startPoint().first, y1 = h.startPoint().second;
+    int x2 = h.endPoint().first, y2 = h.endPoint().second;
+    
+    //Same connection, this includes the hall itself
+    for (int i = pairGroup[id].first; i < pairGroup[id].second; i++)
+        remove(pairIds[i]);
+    
+    //Crossing halls run the other way through one of the lines this hall covers,
+    //equal halls share its own line
+    if (h.dir() == EAST) {
+        for (int x = x1; x <= x2; x++)
+            for (int i = colStart[x]; i < colStart[x + 1]; i++)
+                if (pos[colIds[i]] >= 0 && h.crosses(halls[colIds[i]]))
+                    remove(colIds[i]);
+        for (int i = rowStart[y1]; i < rowStart[y1 + 1]; i++)
+            if (pos[rowIds[i]] >= 0 && h.equals(halls[rowIds[i]]))
+                remove(rowIds[i]);
+    } else {
+        for (int y = y1; y <= y2; y++)
+            for (int i = rowStart[y]; i < rowStart[y + 1]; i++)
+                if (pos[rowIds[i]] >= 0 && h.crosses(halls[rowIds[i]]))
+                    remove(rowIds[i]);
+        for (int i = colStart[x1]; i < colStart[x1 + 1]; i++)
+            if (pos[colIds[i]] >= 0 && h.equals(halls[colIds[i]]))
+                remove(colIds[i]);
+    }
+}
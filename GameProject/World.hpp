@@ -11,85 +11,320 @@
 
 #include <stdio.h>
 #include <iostream>
-#include <set>
 #include <vector>
-#include <stack>
 #include <algorithm>
+#include <math.h>
+#include "Bitboard.hpp"
+#include "Random.hpp"
+#include "DisjointSet.hpp"
+#include "TileMap.hpp"
+
+enum {
+    NORTH = 0,
+    EAST  = 1,
+    SOUTH = 2,
+    WEST  = 3
+};
+
+//Counter based random streams, see Random::at
+enum {
+    STREAM_CAVE  = 0,
+    STREAM_ROOMS = 1
+};
+
+//Cave fill and smoothing defaults, shared with StaticWorld
+const int CAVE_PERCENT_WALL = 46;
+const int DEFAULT_SMOOTH_PASSES = 5;
+
+//Smallest side a World takes, a wall border around one open cell
+const int MIN_MAP_SIZE = 3;
+
+/*
+ RoomLimits - map dimensions and the range of room sizes, set by the owning World
+ */
+
+struct RoomLimits {
+    int mapW, mapH;
+    int minW, maxW, minH, maxH;
+};
+
+class RoomGrid;
 
 class Room {
 public:
     Room();
-    void set();
+    Room(Random &rng, int attempt, const RoomLimits &limits);
+    Room(int x, int y, int w, int h, int id, int mapW, int mapH);
+    void set(int num);
     
-    bool equals(Room other);
-    static bool compareXY(Room i, Room j);
+    bool equals(const Room &other) const;
+    static bool compareXY(const Room &i, const Room &j);
     
-    std::vector<std::vector<int>> edges();
+    void edge(int dir, int &x1, int &y1, int &x2, int &y2) const;
     
-    bool valid(Room other, int offset);
-    bool valid(std::vector<Room> &others, int offset);
-    bool validX(Room other, int offset);
-    bool validX(std::vector<Room> &others, int offset);
-    bool validY(Room other, int offset);
-    bool validY(std::vector<Room> &others, int offset);
+    bool valid(const Room &other, int offset) const;
+    bool valid(const RoomGrid &others, int offset) const;
+    bool validX(const Room &other, int offset) const;
+    bool validX(const RoomGrid &others, int offset) const;
+    bool validY(const Room &other, int offset) const;
+    bool validY(const RoomGrid &others, int offset) const;
     
-    bool moveXY(std::vector<Room> &others, int offset);
-    bool moveX(std::vector<Room> &others, int offset);
-    bool moveY(std::vector<Room> &others, int offset);
+    bool slideXY(RoomGrid &others, int offset);
+    int slideX(const RoomGrid &others, int offset);
+    int slideY(const RoomGrid &others, int offset);
     
-    int num();
-    std::pair<int, int> coords();
-    std::pair<int, int> dim();
+    int num() const;
+    std::pair<int, int> coords() const;
+    std::pair<int, int> dim() const;
     
 private:
-    static int count, size;
     int x, y, w, h, id;
+    int mapW, mapH;
+};
+
+/*
+ RoomGrid - bucket grid over the map holding a copy of every placed room, indexed by room id.
+ A room is listed in every bucket its rectangle [x, x + w] x [y, y + h] touches, so overlap
+ queries only look at rooms near the query rectangle. Buckets are sized from the largest room
+ so a room touches at most four of them. The bucket lists are linked through one pool of
+ entries that keeps its capacity across resets, so a grid that is reused stops allocating.
+ 
+ reset - empty the grid, rooms is how many rooms to make room for up front
+ any - true if pred holds for a room touching [x1, x2] x [y1, y2], a room may be tested more than once
+ each - calls fn for every room touching [x1, x2] x [y1, y2], a room may be visited more than once
+ */
+
+class RoomGrid {
+public:
+    RoomGrid();
+    
+    void reset(int mapW, int mapH, int cellSize, size_t rooms = 0);
+    void insert(const Room &r);
+    void update(const Room &r);
+    
+    template <typename Pred>
+    bool any(int x1, int y1, int x2, int y2, Pred pred) const;
+    template <typename Fn>
+    void each(int x1, int y1, int x2, int y2, Fn fn) const;
+    
+private:
+    //A room's place in one bucket list, free entries are linked the same way
+    struct Entry {
+        int id, next;
+    };
+    
+    std::vector<int> heads;
+    std::vector<Entry> entries;
+    std::vector<Room> placed;
+    int freeEntry;
+    int cols, rows, cell;
+    
+    void bucketRange(const Room &r, int &bx1, int &by1, int &bx2, int &by2) const;
+    void link(int bucket, int id);
+    void unlink(int bucket, int id);
 };
 
+template <typename Pred>
+bool RoomGrid::any(int x1, int y1, int x2, int y2, Pred pred) const {
+    int bx1 = std::max(0, x1 / cell), by1 = std::max(0, y1 / cell);
+    int bx2 = std::min(cols - 1, std::max(0, x2) / cell), by2 = std::min(rows - 1, std::max(0, y2) / cell);
+    
+    for (int by = by1; by <= by2; by++)
+        for (int bx = bx1; bx <= bx2; bx++)
+            for (int e = heads[by * cols + bx]; e >= 0; e = entries[e].next)
+                if (pred(placed[entries[e].id]))
+                    return true;
+    return false;
+}
+
+template <typename Fn>
+void RoomGrid::each(int x1, int y1, int x2, int y2, Fn fn) const {
+    any(x1, y1, x2, y2, [&](const Room &r) {
+        fn(r);
+        return false;
+    });
+}
+
 class Hall {
 public:
-    Hall(int s, int sxy, int e, int exy, int d);
+    Hall(int s, int sx, int sy, int e, int ex, int ey, int d);
     Hall();
     
-    bool equals(Hall other);
-    bool sameConnection(Hall other);
-    bool crosses(Hall other);
+    bool equals(const Hall &other) const;
+    bool sameConnection(const Hall &other) const;
+    bool crosses(const Hall &other) const;
+    
+    int len() const;
+    std::pair<int, int> rooms() const;
+    std::pair<int, int> startPoint() const;
+    std::pair<int, int> endPoint() const;
+    int dir() const;
     
-    int len();
-    std::pair<int, int> rooms();
-    std::pair<int, int> coords();
-    int dir();
+private:
+    int start, end, direction, length;
+    int sx, sy, ex, ey;
+};
+
+/*
+ HallIndex - the set of candidate halls still open while rooms are being connected.
+ Candidates are bucketed by row (EAST halls) and column (SOUTH halls) and grouped by their
+ (start, end) room pair, so accepting a hall only looks at the candidates it could cross or
+ duplicate. Removed candidates are swapped out of the open list in O(1) and skipped lazily in
+ the buckets.
+ 
+ reset - index a new candidate list, all open
+ size, at - the open candidates, in no particular order
+ isOpen - whether a candidate is still open
+ remove - close one candidate
+ accept - close a candidate and every open one that shares its connection or crosses it
+ */
+
+class HallIndex {
+public:
+    void reset(const std::vector<Hall> &candidates, int mapW, int mapH);
+    
+    size_t size() const;
+    int at(size_t i) const;
+    const Hall &hall(int id) const;
+    bool isOpen(int id) const;
+    
+    void remove(int id);
+    void accept(int id);
     
 private:
-    int start, startxy, end, endxy, direction, length;
-    static int size;
+    std::vector<Hall> halls;
+    std::vector<int> open, pos;
+    std::vector<int> rowStart, rowIds, colStart, colIds;
+    std::vector<int> pairIds;
+    std::vector<std::pair<int, int>> pairGroup;
+    
+    static uint64_t pairKey(const Hall &h);
+    static void bucket(const std::vector<Hall> &halls, int dir, int lines, std::vector<int> &start, std::vector<int> &ids);
+};
+
+/*
+ DungeonParams - see World::buildDungeon
+ */
+
+struct DungeonParams {
+    int numOfRooms;
+    int maxAttempts;
+    int roomDistanceThreshold;
+    int minRoom, maxRoom;
+    bool kruskal;
+    int extraLoops;
+    
+    DungeonParams();
+};
+
+/*
+ GenerationStats - counters and stage times from the builders, see World::collectStats.
+ Everything adds up across builds, so one GenerationStats can cover a whole batch. reset
+ clears it, += merges another, for example one per thread.
+ 
+ caves, dungeons - builds counted
+ *Seconds - wall clock time spent in each stage
+ smoothPasses - automaton passes run by smoothCave, fewer than asked for when active smoothing settles
+ regionsFound - open regions seen by cleanCave, before all but the largest are walled in
+ cellsRemoved - open cells walled in by cleanCave
+ roomsPlaced - rooms that fit during placeRooms
+ placementAttempts - rooms tried during placeRooms, the ones that fit included
+ mostAttempts - most rooms tried for one placement, in any build
+ compactionPasses, compactionMoves - passes over the rooms and slides that moved a room
+ hallCandidates - possible halls found by findHalls
+ hallsAccepted, hallsRejected - candidates drawn by selectHalls and kept or thrown out, with
+                                kruskal every candidate is one or the other
+ strandedRooms - dungeons left with a room that could not be connected
+ */
+
+struct GenerationStats {
+    uint64_t caves, dungeons;
+    double fillSeconds, smoothSeconds, cleanupSeconds;
+    double placeSeconds, compactSeconds, hallFindSeconds, hallSelectSeconds;
+    uint64_t smoothPasses;
+    uint64_t regionsFound, cellsRemoved;
+    uint64_t roomsPlaced, placementAttempts, mostAttempts;
+    uint64_t compactionPasses, compactionMoves;
+    uint64_t hallCandidates, hallsAccepted, hallsRejected;
+    uint64_t strandedRooms;
+    
+    GenerationStats();
+    void reset();
+    GenerationStats &operator+=(const GenerationStats &other);
 };
 
-class World {
+class World final : public TileMap {
 public:
-    World();
+    World(uint64_t seed = 0);
+    World(int width, int height, uint64_t seed = 0);
     
+    void seed(uint64_t s);
+    void resize(int width, int height);
     void clear();
     void set(int x, int y, int val);
     void swap(int x1, int y1, int x2, int y2);
     
-    void buildCave();
-    void buildDungeon();
+    void collectStats(GenerationStats *s);
+    void setSmoothing(int passes, bool active);
+    
+    void buildCave(ThreadPool *pool = NULL);
+    bool buildDungeon(const DungeonParams &params = DungeonParams());
+    
+    void fillCave(ThreadPool *pool = NULL);
+    void smoothCave(ThreadPool *pool = NULL);
+    void cleanCave();
+    
+    void placeRooms(const DungeonParams &params);
+    void compactRooms(const DungeonParams &params);
+    void findHalls();
+    bool selectHalls(const DungeonParams &params);
+    
+    bool save(const char *path) const;
+    bool load(const char *path);
+    
+    int getWidth() const override;
+    int getHeight() const override;
+    uint64_t getVersion() const;
+    const Tile *tiles() const override;
+    const std::vector<Room> &getRooms() const;
+    const std::vector<Hall> &getHalls() const;
+    bool reachable(int x1, int y1, int x2, int y2);
+    int regionCount();
     
     friend std::ostream &operator<<(std::ostream &out, const World &w);
     
 private:
-    std::vector<int> map;
-    std::vector<Room> rooms;
-    std::vector<Hall> halls;
-    int size;
-    
-    void placeRoom(Room r);
-    std::vector<Hall> setPossHalls();
-    std::vector<Hall> updateHalls(std::vector<Hall> possibles);
-    int getRoomByEdge(int coord);
-    void placeHall(Hall h);
-    std::vector<bool> flood(int coord, int &c);
+    std::vector<Tile> map;
+    std::vector<Room> rooms, roomsStill, roomsMoved;
+    std::vector<Hall> halls, possHalls;
+    std::vector<int> hallOrder;
+    std::vector<int> edgeOwner;
+    RoomGrid roomGrid;
+    HallIndex hallIndex;
+    std::vector<int64_t> regions;
+    std::vector<size_t> regionSizes;
+    DisjointSet roomSets, cellSets;
+    Bitboard cells, cellsTemp;
+    Random rng;
+    GenerationStats *stats;
+    int smoothPasses;
+    bool activeSmoothing;
+    uint64_t version;
+    int width, height;
+    bool regionsValid;
+    
+    size_t index(int x, int y) const;
+    RoomLimits roomLimits(const DungeonParams &params) const;
+    static int largestRoom(int mapSide);
+    void placeRoom(const Room &r);
+    void setPossHalls(std::vector<Hall> &possibles);
+    int getRoomByEdge(size_t coord) const;
+    void placeHall(const Hall &h);
+    bool randomHalls(const DungeonParams &params);
+    bool kruskalHalls(const DungeonParams &params);
+    int nextHall(size_t i);
+    int labelRegions(std::vector<size_t> &sizes);
+    void keepRegions(const std::vector<size_t> &sizes, size_t minCells);
 };
 
 #endif /* World_hpp */
@@ -0,0 +1,155 @@
+//
+//  WorldFile.cpp
+//  GameProject
+//
+//  Created by Orin Elmquist on 6/12/18.
+//  Copyright © 2018 Orin Elmquist. All rights reserved.
+//
+
+#include "WorldFile.hpp"
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static uint64_t align8(uint64_t n) {
+    return (n + 7) & ~(uint64_t)7;
+}
+
+/*
+ Header
+ 
+ initWorldFileHeader - fills in the magic, version and section offsets for a world of this size
+ checkWorldFileHeader - true if the header is one we can read and its sections fit in fileSize
+ */
+
+void initWorldFileHeader(WorldFileHeader &header, uint32_t width, uint32_t height, uint64_t seed, uint32_t rooms, uint32_t halls) {
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "TGWF", 4);
+    header.version = WORLD_FILE_VERSION;
+    header.byteOrder = WORLD_FILE_BYTE_ORDER;
+    header.width = width;
+    header.height = height;
+    header.seed = seed;
+    header.roomCount = rooms;
+    header.hallCount = halls;
+    header.tilesOffset = sizeof(WorldFileHeader);
+    header.roomsOffset = align8(header.tilesOffset + (uint64_t)width * height);
+    header.hallsOffset = align8(header.roomsOffset + (uint64_t)rooms * sizeof(RoomRecord));
+    header.fileSize = header.hallsOffset + (uint64_t)halls * sizeof(HallRecord);
+}
+
+bool checkWorldFileHeader(const WorldFileHeader &header, size_t fileSize) {
+    WorldFileHeader expected;
+    
+    if (fileSize < sizeof(WorldFileHeader) || memcmp(header.magic, "TGWF", 4) != 0)
+        return false;
+    if (header.version != WORLD_FILE_VERSION || header.byteOrder != WORLD_FILE_BYTE_ORDER)
+        return false;
+    if (header.width > INT32_MAX || header.height > INT32_MAX)
+        return false;
+    
+    //Sections must sit exactly where this version puts them
+    initWorldFileHeader(expected, header.width, header.height, header.seed, header.roomCount, header.hallCount);
+    return header.tilesOffset == expected.tilesOffset && header.roomsOffset == expected.roomsOffset
+        && header.hallsOffset == expected.hallsOffset && header.fileSize == expected.fileSize
+        && header.fileSize <= fileSize;
+}
+
+
+////////////////////////
+// Mapped World Class //
+////////////////////////
+
+MappedWorld::MappedWorld() : data(NULL), bytes(0), header(NULL) { }
+
+MappedWorld::~MappedWorld() {
+    close();
+}
+
+bool MappedWorld::open(const char *path) {
+    struct stat st;
+    int fd;
+    
+    close();
+    
+    fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+    
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(WorldFileHeader)) {
+        ::close(fd);
+        return false;
+    }
+    
+    bytes = (size_t)st.st_size;
+    data = mmap(NULL, bytes, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    
+    if (data == MAP_FAILED) {
+        data = NULL;
+        bytes = 0;
+        return false;
+    }
+    
+    header = (const WorldFileHeader *)data;
+    if (!checkWorldFileHeader(*header, bytes)) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void MappedWorld::close() {
+    if (data)
+        munmap(data, bytes);
+    data = NULL;
+    bytes = 0;
+    header = NULL;
+}
+
+bool MappedWorld::isOpen() const {
+    return header != NULL;
+}
+
+
+/*
+ Value retrevial, only valid while open
+ */
+
+int MappedWorld::getWidth() const {
+    return (int)header->width;
+}
+
+int MappedWorld::getHeight() const {
+    return (int)header->height;
+}
+
+uint64_t MappedWorld::getSeed() const {
+    return header->seed;
+}
+
+int MappedWorld::get(int x, int y) const {
+    return tiles()[(size_t)y * header->width + x];
+}
+
+const Tile *MappedWorld::tiles() const {
+    return (const uint8_t *)data + header->tilesOffset;
+}
+
+size_t MappedWorld::roomCount() const {
+    return header->roomCount;
+}
+
+const RoomRecord &MappedWorld::room(size_t i) const {
+    return ((const RoomRecord *)((const char *)data + header->roomsOffset))[i];
+}
+
+size_t MappedWorld::hallCount() const {
+    return header->hallCount;
+}
+
+const HallRecord &MappedWorld::hall(size_t i) const {
+    return ((const HallRecord *)((const char *)data + header->hallsOffset))[i];
+}
@@ -0,0 +1,98 @@
+//
+//  WorldFile.hpp
+//  GameProject
+//
+//  Created by Orin Elmquist on 6/12/18.
+//  Copyright © 2018 Orin Elmquist. All rights reserved.
+//
+
+#ifndef WorldFile_hpp
+#define WorldFile_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "TileMap.hpp"
+
+/*
+ Binary world file, written by World::save and read by World::load or MappedWorld.
+ 
+ Layout, every section starts on an 8 byte boundary:
+     WorldFileHeader  64 bytes
+     tiles            width * height bytes, row major, one Tile (FLOOR, WALL, DOOR) each
+     rooms            roomCount RoomRecords
+     halls            hallCount HallRecords
+ 
+ Fields are stored in the writer's byte order. byteOrder lets a reader with the other order
+ reject the file instead of misreading it. version is bumped whenever the layout changes,
+ readers refuse versions they do not know.
+ */
+
+const uint16_t WORLD_FILE_VERSION = 1;
+const uint16_t WORLD_FILE_BYTE_ORDER = 0x0102;
+
+struct WorldFileHeader {
+    char magic[4];
+    uint16_t version;
+    uint16_t byteOrder;
+    uint32_t width, height;
+    uint64_t seed;
+    uint32_t roomCount, hallCount;
+    uint64_t tilesOffset;
+    uint64_t roomsOffset;
+    uint64_t hallsOffset;
+    uint64_t fileSize;
+};
+
+struct RoomRecord {
+    int32_t x, y, w, h, id;
+};
+
+struct HallRecord {
+    int32_t start, end, dir;
+    int32_t sx, sy, ex, ey;
+};
+
+static_assert(sizeof(WorldFileHeader) == 64, "WorldFileHeader layout changed");
+static_assert(sizeof(RoomRecord) == 20, "RoomRecord layout changed");
+static_assert(sizeof(HallRecord) == 28, "HallRecord layout changed");
+
+void initWorldFileHeader(WorldFileHeader &header, uint32_t width, uint32_t height, uint64_t seed, uint32_t rooms, uint32_t halls);
+bool checkWorldFileHeader(const WorldFileHeader &header, size_t fileSize);
+
+/*
+ MappedWorld - read only view of a world file mapped into memory.
+ open maps the file and checks the header, nothing is parsed or copied. Tiles, rooms and halls
+ are read straight from the mapping, which stays valid until close or destruction.
+ */
+
+class MappedWorld final : public TileMap {
+public:
+    MappedWorld();
+    ~MappedWorld();
+    MappedWorld(const MappedWorld &) = delete;
+    MappedWorld &operator=(const MappedWorld &) = delete;
+    
+    bool open(const char *path);
+    void close();
+    bool isOpen() const;
+    
+    int getWidth() const override;
+    int getHeight() const override;
+    uint64_t getSeed() const;
+    
+    int get(int x, int y) const;
+    const Tile *tiles() const override;
+    
+    size_t roomCount() const;
+    const RoomRecord &room(size_t i) const;
+    size_t hallCount() const;
+    const HallRecord &hall(size_t i) const;
+    
+private:
+    void *data;
+    size_t bytes;
+    const WorldFileHeader *header;
+};
+
+#endif /* WorldFile_hpp */
@@ -0,0 +1,477 @@
+//
+//  bench.cpp
+//  GameProject
+//
+//  Created by Orin Elmquist on 6/12/18.
+//  Copyright © 2018 Orin Elmquist. All rights reserved.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <new>
+#include <vector>
+#include <algorithm>
+#include "World.hpp"
+#include "Renderer.hpp"
+#include "FlowField.hpp"
+#include "FieldOfView.hpp"
+#include "StaticWorld.hpp"
+#include "ChunkWorld.hpp"
+#include "RoomGraph.hpp"
+
+/*
+ thegame_bench [--seeds n] [--first n] [--size WxH]... [--rooms n]... [--kruskal] [--loops n] [--passes n] [--active] [--threads n] [--check-allocs] [--out file]
+ 
+ Times every generation stage on its own over a matrix of map sizes, room counts and seeds,
+ and writes the results as JSON (stdout by default).
+     
+     --seeds, --first - seeds first .. first + seeds - 1 (default 10 seeds from 1)
+     --size - map size, may be repeated (default 100x100, 400x400, 1000x1000, 2000x2000)
+     --rooms - dungeon room count, may be repeated (default 20, 80, 200)
+     --kruskal, --loops - Kruskal hall selection and its extra loops, see World::buildDungeon
+     --passes, --active - cave smoothing passes and active set smoothing, see World::setSmoothing
+     --threads - pool size for fill and smoothing, 0 runs them serially (default 0)
+     --check-allocs - warm up on every seed instead of the first, then fail (exit status 2) if any
+                      stage still allocates, listing the stages on stderr
+ 
+ Cave stages (fill, smooth, cleanup, render, flow_build, flow_retarget, fov) are run once per size
+ and seed, dungeon stages
+ (room_placement, compaction, hall_discovery, hall_selection, render, fov) once per size, room
+ count and seed. Each configuration gets one World, warmed up with one unrecorded build, so allocation
+ counts are for a World that is being reused, as in batch mode. Buffers only grow when a build needs
+ more than any before it, so once every seed has been seen the pipeline should not allocate at all.
+ flow_build builds a FlowField to the open tile nearest the middle of the map, flow_retarget
+ then moves that target up to four tiles.
+ fov computes FOV_QUERIES fields of view of radius FOV_RADIUS from open tiles spread over the map.
+ path finds PATH_QUERIES RoomGraph paths between rooms, which rebuilds the door graph, then asks
+ for the same paths again, which come from its cache. The graph and cache are hash maps that
+ allocate as they fill, so path is left out of --check-allocs.
+ Sizes with a StaticWorld instantiation (the default four) also run the static_cave stages (fill,
+ smooth, cleanup, render), the same caves built serially by StaticWorld<W, H>, for comparison.
+ The chunk stage (chunk_walk) reads every cell of a window the size of the map from a ChunkWorld,
+ see ChunkWalk.
+ 
+ Per stage and configuration:
+     median_ms, p99_ms - nearest rank over the seeds
+     cells_per_second - map cells over the median time
+     allocations_per_run - calls to any form of operator new, averaged over the seeds
+ */
+
+//Every allocation in the process goes through here, the count is read around each stage.
+//All the replaceable forms are replaced (array, aligned, nothrow, sized delete) so none of them
+//bypass the count, and they all use malloc and free so any new pairs with any delete.
+static std::atomic<uint64_t> allocations(0);
+
+static void *allocate(size_t n, size_t align) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+#if __cpp_aligned_new
+    if (align > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+        void *p = NULL;
+        if (posix_memalign(&p, align, n ? n : 1) != 0)
+            p = NULL;
+        return p;
+    }
+#endif
+    (void)align;
+    return malloc(n ? n : 1);
+}
+
+static void *allocateOrThrow(size_t n, size_t align) {
+    void *p = allocate(n, align);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void *operator new(size_t n) {
+    return allocateOrThrow(n, 0);
+}
+
+void *operator new[](size_t n) {
+    return allocateOrThrow(n, 0);
+}
+
+void *operator new(size_t n, const std::nothrow_t &) noexcept {
+    return allocate(n, 0);
+}
+
+void *operator new[](size_t n, const std::nothrow_t &) noexcept {
+    return allocate(n, 0);
+}
+
+void operator delete(void *p) noexcept {
+    free(p);
+}
+
+void operator delete[](void *p) noexcept {
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept {
+    free(p);
+}
+
+void operator delete(void *p, const std::nothrow_t &) noexcept {
+    free(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t &) noexcept {
+    free(p);
+}
+
+//Aligned new is C++17, and compilers can turn it off (-fno-aligned-new)
+#if __cpp_aligned_new
+
+void *operator new(size_t n, std::align_val_t a) {
+    return allocateOrThrow(n, (size_t)a);
+}
+
+void *operator new[](size_t n, std::align_val_t a) {
+    return allocateOrThrow(n, (size_t)a);
+}
+
+void *operator new(size_t n, std::align_val_t a, const std::nothrow_t &) noexcept {
+    return allocate(n, (size_t)a);
+}
+
+void *operator new[](size_t n, std::align_val_t a, const std::nothrow_t &) noexcept {
+    return allocate(n, (size_t)a);
+}
+
+void operator delete(void *p, std::align_val_t) noexcept {
+    free(p);
+}
+
+void operator delete[](void *p, std::align_val_t) noexcept {
+    free(p);
+}
+
+void operator delete(void *p, size_t, std::align_val_t) noexcept {
+    free(p);
+}
+
+void operator delete[](void *p, size_t, std::align_val_t) noexcept {
+    free(p);
+}
+
+void operator delete(void *p, std::align_val_t, const std::nothrow_t &) noexcept {
+    free(p);
+}
+
+void operator delete[](void *p, std::align_val_t, const std::nothrow_t &) noexcept {
+    free(p);
+}
+
+#endif
+
+//Unchecked stages are timed and counted but left out of --check-allocs
+template <class Map>
+struct Stage {
+    const char *name;
+    std::function<void(Map &w)> run;
+    bool checked = true;
+};
+
+struct Result {
+    const char *kind, *stage;
+    bool checked;
+    int width, height, rooms;
+    std::vector<double> seconds;
+    uint64_t allocs;
+};
+
+static double percentile(std::vector<double> v, double p) {
+    std::sort(v.begin(), v.end());
+    size_t rank = (size_t)(p * v.size() + 0.999999);
+    return v[std::min(v.size(), std::max((size_t)1, rank)) - 1];
+}
+
+//Runs the stages in order on w for every seed, recording each stage separately
+template <class Map>
+static void runStages(Map &w, const std::vector<Stage<Map>> &stages, const char *kind, int rooms,
+                      uint64_t first, uint64_t seeds, uint64_t warmups, std::vector<Result> &results) {
+    size_t base = results.size();
+    
+    for (const Stage<Map> &s : stages) {
+        results.push_back({kind, s.name, s.checked, w.getWidth(), w.getHeight(), rooms, std::vector<double>(), 0});
+        results.back().seconds.reserve(seeds);
+    }
+    
+    //Warm up, buffers grow to size here
+    for (uint64_t seed = first; seed < first + warmups; seed++) {
+        w.seed(seed);
+        for (const Stage<Map> &s : stages)
+            s.run(w);
+    }
+    
+    for (uint64_t seed = first; seed < first + seeds; seed++) {
+        w.seed(seed);
+        for (size_t i = 0; i < stages.size(); i++) {
+            uint64_t a = allocations.load();
+            auto start = std::chrono::steady_clock::now();
+            
+            stages[i].run(w);
+            
+            auto end = std::chrono::steady_clock::now();
+            results[base + i].allocs += allocations.load() - a;
+            results[base + i].seconds.push_back(std::chrono::duration<double>(end - start).count());
+        }
+    }
+}
+
+//First open tile at or after the middle of the map, in row order
+static void findTarget(const World &w, int &tx, int &ty) {
+    size_t cells = (size_t)w.getWidth() * w.getHeight();
+    
+    for (size_t i = cells / 2; i < cells + cells / 2; i++)
+        if (w.tiles()[i % cells] != WALL) {
+            tx = (int)(i % cells % w.getWidth());
+            ty = (int)(i % cells / w.getWidth());
+            return;
+        }
+}
+
+//Two steps east and two south, skipping any step into a wall
+static void moveTarget(const World &w, int &tx, int &ty) {
+    const int dx[4] = {1, 1, 0, 0}, dy[4] = {0, 0, 1, 1};
+    
+    for (int i = 0; i < 4; i++) {
+        int x = tx + dx[i], y = ty + dy[i];
+        if (x < w.getWidth() && y < w.getHeight() && w.tiles()[(size_t)y * w.getWidth() + x] != WALL) {
+            tx = x;
+            ty = y;
+        }
+    }
+}
+
+const int FOV_QUERIES = 1024;
+const int FOV_RADIUS = 8;
+
+//One field of view from the first open tile at or after each of FOV_QUERIES evenly spaced tiles
+static void sweepFov(const World &w, FieldOfView &fov) {
+    size_t cells = (size_t)w.getWidth() * w.getHeight();
+    
+    for (int q = 0; q < FOV_QUERIES; q++) {
+        size_t i = cells * q / FOV_QUERIES;
+        while (i < cells && w.tiles()[i] == WALL)
+            i++;
+        if (i < cells)
+            fov.compute(w, (int)(i % w.getWidth()), (int)(i / w.getWidth()), FOV_RADIUS);
+    }
+}
+
+//A window over a ChunkWorld, each seed moves it to a part of the world not seen before. The cache
+//holds two rows of the window's chunks, so a walk row by row hits on the rest of a chunk's rows
+//and every new chunk evicts an old one.
+struct ChunkWalk {
+    ChunkWorld world;
+    int width, height;
+    int64_t x0;
+    size_t open;
+    
+    ChunkWalk(int w, int h) : world(0, 2 * (w / ChunkWorld::CHUNK_SIZE + 2)), width(w), height(h), x0(0), open(0) { }
+    
+    void seed(uint64_t s) {
+        x0 = (int64_t)s * 1000000;
+    }
+    
+    void walk() {
+        for (int y = 0; y < height; y++)
+            for (int x = 0; x < width; x++)
+                open += world.get(x0 + x, y) != WALL;
+    }
+    
+    int getWidth() const {
+        return width;
+    }
+    
+    int getHeight() const {
+        return height;
+    }
+};
+
+const int PATH_QUERIES = 32;
+
+//PATH_QUERIES paths between rooms spread over the dungeon, then the same ones again from the cache
+static void sweepPaths(const World &w, RoomGraph &graph, RoomGraph::Path &path) {
+    const std::vector<Room> &rooms = w.getRooms();
+    
+    if (rooms.size() < 2)
+        return;
+    for (int pass = 0; pass < 2; pass++)
+        for (int q = 0; q < PATH_QUERIES; q++) {
+            const Room &a = rooms[q % rooms.size()], &b = rooms[(q * 7 + rooms.size() / 2) % rooms.size()];
+            graph.findPath(w, a.coords().first + 1, a.coords().second + 1, b.coords().first + 1, b.coords().second + 1, path);
+        }
+}
+
+//The cave stages on a StaticWorld<W, H>, if the size is W x H
+template <int W, int H>
+static void runStatic(int width, int height, int passes, uint64_t first, uint64_t seeds, uint64_t warmups,
+                      std::vector<Result> &results) {
+    if (width != W || height != H)
+        return;
+    
+    StaticWorld<W, H> *world = new StaticWorld<W, H>();
+    std::vector<char> text(StaticWorld<W, H>::TEXT_SIZE);
+    
+    std::vector<Stage<StaticWorld<W, H>>> stages = {
+        {"fill", [&](StaticWorld<W, H> &w) { w.fillCave(); }},
+        {"smooth", [&](StaticWorld<W, H> &w) { w.smoothCave(passes); }},
+        {"cleanup", [&](StaticWorld<W, H> &w) { w.cleanCave(); }},
+        {"render", [&](StaticWorld<W, H> &w) { w.render(text.data()); }}
+    };
+    
+    runStages(*world, stages, "static_cave", 0, first, seeds, warmups, results);
+    delete world;
+}
+
+static int usage() {
+    fprintf(stderr, "usage: thegame_bench [--seeds n] [--first n] [--size WxH]... [--rooms n]... [--kruskal] [--loops n] [--passes n] [--active] [--threads n] [--check-allocs] [--out file]\n");
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    std::vector<std::pair<int, int>> sizes;
+    std::vector<int> roomCounts;
+    uint64_t first = 1, seeds = 10;
+    unsigned threads = 0;
+    int passes = 5;
+    bool active = false, checkAllocs = false;
+    const char *out = NULL;
+    DungeonParams params;
+    int w, h;
+    
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--seeds") == 0 && i + 1 < argc)
+            seeds = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--first") == 0 && i + 1 < argc)
+            first = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc && sscanf(argv[i + 1], "%dx%d", &w, &h) == 2 && w >= MIN_MAP_SIZE && h >= MIN_MAP_SIZE) {
+            sizes.push_back(std::make_pair(w, h));
+            i++;
+        } else if (strcmp(argv[i], "--rooms") == 0 && i + 1 < argc && atoi(argv[i + 1]) >= 0)
+            roomCounts.push_back(atoi(argv[++i]));
+        else if (strcmp(argv[i], "--kruskal") == 0)
+            params.kruskal = true;
+        else if (strcmp(argv[i], "--loops") == 0 && i + 1 < argc)
+            params.extraLoops = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--passes") == 0 && i + 1 < argc)
+            passes = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--active") == 0)
+            active = true;
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            threads = (unsigned)atoi(argv[++i]);
+        else if (strcmp(argv[i], "--check-allocs") == 0)
+            checkAllocs = true;
+        else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+            out = argv[++i];
+        else
+            return usage();
+    }
+    
+    if (seeds == 0)
+        return usage();
+    if (sizes.empty())
+        sizes = {{100, 100}, {400, 400}, {1000, 1000}, {2000, 2000}};
+    if (roomCounts.empty())
+        roomCounts = {20, 80, 200};
+    
+    uint64_t warmups = checkAllocs ? seeds : 1;
+    ThreadPool *pool = threads > 0 ? new ThreadPool(threads) : NULL;
+    Renderer renderer;
+    FlowField flow;
+    FieldOfView fov;
+    RoomGraph graph;
+    RoomGraph::Path path;
+    int tx = 0, ty = 0;
+    std::vector<Result> results;
+    
+    std::vector<Stage<World>> cave = {
+        {"fill", [&](World &w) { w.fillCave(pool); }},
+        {"smooth", [&](World &w) { w.smoothCave(pool); }},
+        {"cleanup", [&](World &w) { w.cleanCave(); }},
+        {"render", [&](World &w) { renderer.render(w); }},
+        {"flow_build", [&](World &w) { findTarget(w, tx, ty); flow.build(w, tx, ty); }},
+        {"flow_retarget", [&](World &w) { moveTarget(w, tx, ty); flow.retarget(w, tx, ty); }},
+        {"fov", [&](World &w) { sweepFov(w, fov); }}
+    };
+    
+    std::vector<Stage<ChunkWalk>> chunk = {
+        {"chunk_walk", [&](ChunkWalk &c) { c.walk(); }}
+    };
+    
+    std::vector<Stage<World>> dungeon = {
+        {"room_placement", [&](World &w) { w.placeRooms(params); }},
+        {"compaction", [&](World &w) { w.compactRooms(params); }},
+        {"hall_discovery", [&](World &w) { w.findHalls(); }},
+        {"hall_selection", [&](World &w) { w.selectHalls(params); }},
+        {"render", [&](World &w) { renderer.render(w); }},
+        {"fov", [&](World &w) { sweepFov(w, fov); }},
+        {"path", [&](World &w) { sweepPaths(w, graph, path); }, false}
+    };
+    
+    for (const std::pair<int, int> &size : sizes) {
+        World world(size.first, size.second);
+        
+        world.setSmoothing(passes, active);
+        runStages(world, cave, "cave", 0, first, seeds, warmups, results);
+        runStatic<100, 100>(size.first, size.second, passes, first, seeds, warmups, results);
+        runStatic<400, 400>(size.first, size.second, passes, first, seeds, warmups, results);
+        runStatic<1000, 1000>(size.first, size.second, passes, first, seeds, warmups, results);
+        runStatic<2000, 2000>(size.first, size.second, passes, first, seeds, warmups, results);
+        
+        ChunkWalk walk(size.first, size.second);
+        runStages(walk, chunk, "chunk", 0, first, seeds, warmups, results);
+        for (int rooms : roomCounts) {
+            params.numOfRooms = rooms;
+            runStages(world, dungeon, "dungeon", rooms, first, seeds, warmups, results);
+        }
+    }
+    
+    delete pool;
+    
+    FILE *file = out ? fopen(out, "w") : stdout;
+    if (!file) {
+        fprintf(stderr, "thegame_bench: cannot write %s\n", out);
+        return 1;
+    }
+    
+    fprintf(file, "{\n  \"benchmark\": \"thegame_bench\",\n  \"first_seed\": %llu,\n  \"seeds\": %llu,\n  \"threads\": %u,\n  \"smooth_passes\": %d,\n  \"active_smoothing\": %s,\n  \"hall_selection\": \"%s\",\n  \"extra_loops\": %d,\n  \"results\": [\n",
+            (unsigned long long)first, (unsigned long long)seeds, threads, passes, active ? "true" : "false",
+            params.kruskal ? "kruskal" : "random", params.extraLoops);
+    
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result &r = results[i];
+        double median = percentile(r.seconds, 0.5);
+        
+        fprintf(file, "    {\"kind\": \"%s\", \"stage\": \"%s\", \"width\": %d, \"height\": %d, \"rooms\": %d, "
+                "\"runs\": %zu, \"median_ms\": %.4f, \"p99_ms\": %.4f, \"cells_per_second\": %.0f, \"allocations_per_run\": %.2f}%s\n",
+                r.kind, r.stage, r.width, r.height, r.rooms, r.seconds.size(), median * 1e3, percentile(r.seconds, 0.99) * 1e3,
+                median > 0 ? (double)r.width * r.height / median : 0.0, (double)r.allocs / r.seconds.size(),
+                i + 1 < results.size() ? "," : "");
+    }
+    
+    fprintf(file, "  ]\n}\n");
+    if (file != stdout)
+        fclose(file);
+    
+    int allocating = 0;
+    if (checkAllocs)
+        for (const Result &r : results)
+            if (r.checked && r.allocs > 0) {
+                fprintf(stderr, "thegame_bench: %s %s at %dx%d, %d rooms allocated %llu times\n",
+                        r.kind, r.stage, r.width, r.height, r.rooms, (unsigned long long)r.allocs);
+                allocating++;
+            }
+    
+    return allocating > 0 ? 2 : 0;
+}
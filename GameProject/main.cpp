@@ -7,25 +7,158 @@
 //
 
 #include <iostream>
+#include <string>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
+#include <sys/stat.h>
 #include "Game.hpp"
+#include "Batch.hpp"
+#include "Renderer.hpp"
+#include "Trace.hpp"
 
 //const unsigned int SEED = 143245543;
 
 //Seed         Error
-//1529537124   Unconnected part of cave
+//1529537124   Unconnected part of cave (fixed, flood counted cells more than once)
+//Seeds like these can be found with thegame_seedsearch, see seedsearch.cpp
 
-int main() {
+/*
+ Batch mode
+ 
+ thegame batch <first seed> <count> [--cave] [--dungeon] [--size WxH] [--rooms n] [--kruskal] [--loops n] [--passes n] [--active] [--threads n] [--out dir] [--binary | --rle | --pgm] [--stats] [--trace file]
+     Builds count worlds starting at first seed. Defaults to 100x100 dungeons only.
+     --kruskal and --loops n select halls with Kruskal's algorithm and keep n extra halls as loops,
+     see World::buildDungeon.
+     --passes and --active set the cave smoothing, see World::setSmoothing.
+     With --out each world is written to dir/<seed>.txt, dir/<seed>.rle, dir/<seed>.pgm, or
+     dir/<seed>.world with --binary (see Renderer.hpp and WorldFile.hpp).
+     With --stats the GenerationStats for the whole batch are printed after the timing.
+     With --trace the spans recorded during the batch are written to file as Chrome trace JSON,
+     this needs a build with THEGAME_TRACE (see Trace.hpp).
+ */
+
+static int usage() {
+    std::cerr << "usage: thegame batch <first seed> <count> [--cave] [--dungeon] [--size WxH] [--rooms n] [--kruskal] [--loops n] [--passes n] [--active] [--threads n] [--out dir] [--binary | --rle | --pgm] [--stats] [--trace file]" << std::endl;
+    return 1;
+}
+
+static void printStats(const GenerationStats &g) {
+    std::cout << "caves " << g.caves << ", dungeons " << g.dungeons << std::endl
+              << "seconds: fill " << g.fillSeconds << ", smooth " << g.smoothSeconds << ", cleanup " << g.cleanupSeconds
+              << ", place " << g.placeSeconds << ", compact " << g.compactSeconds
+              << ", find halls " << g.hallFindSeconds << ", select halls " << g.hallSelectSeconds << std::endl
+              << "smoothing passes " << g.smoothPasses << std::endl
+              << "regions found " << g.regionsFound << ", cells removed " << g.cellsRemoved << std::endl
+              << "rooms placed " << g.roomsPlaced << ", attempts " << g.placementAttempts << ", most for one room " << g.mostAttempts << std::endl
+              << "compaction passes " << g.compactionPasses << ", moves " << g.compactionMoves << std::endl
+              << "hall candidates " << g.hallCandidates << ", accepted " << g.hallsAccepted << ", rejected " << g.hallsRejected << std::endl
+              << "stranded rooms " << g.strandedRooms << std::endl;
+}
+
+static int batch(int argc, char *argv[]) {
+    BatchParams params;
+    std::string out, trace;
+    Renderer::Mode mode = Renderer::ASCII;
+    bool cave = false, dungeon = false, binary = false;
+    
+    if (argc < 4)
+        return usage();
+    
+    params.firstSeed = strtoull(argv[2], NULL, 10);
+    params.count = strtoull(argv[3], NULL, 10);
+    
+    for (int i = 4; i < argc; i++) {
+        if (strcmp(argv[i], "--cave") == 0)
+            cave = true;
+        else if (strcmp(argv[i], "--dungeon") == 0)
+            dungeon = true;
+        else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc && sscanf(argv[i + 1], "%dx%d", &params.width, &params.height) == 2
+                 && params.width >= MIN_MAP_SIZE && params.height >= MIN_MAP_SIZE)
+            i++;
+        else if (strcmp(argv[i], "--rooms") == 0 && i + 1 < argc && atoi(argv[i + 1]) >= 0)
+            params.rooms.numOfRooms = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--kruskal") == 0)
+            params.rooms.kruskal = true;
+        else if (strcmp(argv[i], "--loops") == 0 && i + 1 < argc)
+            params.rooms.extraLoops = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--passes") == 0 && i + 1 < argc)
+            params.smoothPasses = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--active") == 0)
+            params.activeSmoothing = true;
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            params.threads = (unsigned)atoi(argv[++i]);
+        else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+            out = argv[++i];
+        else if (strcmp(argv[i], "--binary") == 0)
+            binary = true;
+        else if (strcmp(argv[i], "--rle") == 0)
+            mode = Renderer::RLE;
+        else if (strcmp(argv[i], "--pgm") == 0)
+            mode = Renderer::PGM;
+        else if (strcmp(argv[i], "--stats") == 0)
+            params.stats = true;
+        else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+            trace = argv[++i];
+        else
+            return usage();
+    }
+    
+    if (cave || dungeon) {
+        params.cave = cave;
+        params.dungeon = dungeon;
+    }
+    
+    if (!out.empty())
+        mkdir(out.c_str(), 0755);
+    
+    BatchSink sink;
+    if (!out.empty() && binary)
+        sink = [&out](uint64_t seed, const World &w, unsigned) {
+            w.save((out + "/" + std::to_string(seed) + ".world").c_str());
+        };
+    else if (!out.empty())
+        sink = [&out, mode](uint64_t seed, const World &w, unsigned) {
+            static thread_local Renderer renderer;
+            const char *ext = mode == Renderer::RLE ? ".rle" : mode == Renderer::PGM ? ".pgm" : ".txt";
+            FILE *file = fopen((out + "/" + std::to_string(seed) + ext).c_str(), "wb");
+            
+            if (file) {
+                renderer.setMode(mode);
+                renderer.render(w);
+                renderer.write(file);
+                fclose(file);
+            }
+        };
+    
+    BatchStats stats = buildBatch(params, sink);
+    
+    std::cout << stats.worlds << " worlds in " << stats.seconds << " s, "
+              << stats.worldsPerSecond() << " worlds/s" << std::endl;
+    
+    if (params.stats)
+        printStats(stats.generation);
+    
+    if (!trace.empty() && !Trace::flush(trace.c_str()))
+        std::cerr << "could not write " << trace << std::endl;
+    
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    
+    if (argc > 1) {
+        if (strcmp(argv[1], "batch") == 0)
+            return batch(argc, argv);
+        return usage();
+    }
         
 //    unsigned int seed = time(NULL);
     unsigned int seed = 1529537124;
 
-    srand(seed);
-
     std::cout << seed << std::endl << std::endl;
 
-    World w;
+    World w(seed);
 
     w.buildCave();
 
@@ -0,0 +1,279 @@
+//
+//  seedsearch.cpp
+//  GameProject
+//
+//  Created by Orin Elmquist on 6/12/18.
+//  Copyright © 2018 Orin Elmquist. All rights reserved.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include "World.hpp"
+#include "ThreadPool.hpp"
+
+/*
+ thegame_seedsearch <first seed> <count> [--cave] [--stranded] [--disconnected n] [--rooms-below n]
+                    [--floor-outside min max] [--size WxH] [--rooms n] [--kruskal] [--loops n]
+                    [--passes n] [--active] [--threads n] [--limit n]
+
+ Builds seeds first .. first + count - 1 on every core and prints the ones that match, one per
+ line in seed order. Builds dungeons unless --cave is given, with the same options as batch mode.
+
+     --stranded - the dungeon has a room that could not be connected
+     --disconnected - cleanCave walls in at least n open cells cut off from the largest region
+     --rooms-below - fewer than n rooms fit
+     --floor-outside - the fraction of open tiles is below min or above max
+     --limit - stop after the first n matches
+
+ A seed matches when every predicate given holds. The generator runs a stage at a time and stops
+ as soon as every predicate is decided: room counts are known after placeRooms, a cave with too
+ little floor is known before cleanCave (which only walls cells in, so the cleaned cave is always
+ one region and disconnected is judged by what it removed), and a dungeon with too much
+ floor is known before selectHalls (which only carves). Seeds are handed out in chunks of CHUNK,
+ one block of chunks per pool run, so with --limit the scan stops at the first block that
+ reaches it and the matches are still the lowest seeds. The first block is one chunk per thread
+ and each block after doubles, up to BLOCK_CHUNKS per thread, so a small --limit that matches
+ early does not pay for a full block.
+
+ The count of seeds scanned, the time and the matches are printed on stderr.
+ */
+
+const uint64_t CHUNK = 256;
+const uint64_t BLOCK_CHUNKS = 64;
+
+//Predicate states, a seed is done with once none are UNKNOWN or one is NO
+enum {
+    NO,
+    YES,
+    UNKNOWN
+};
+
+enum {
+    STRANDED,
+    DISCONNECTED,
+    ROOMS_BELOW,
+    FLOOR_OUTSIDE,
+    PREDICATES
+};
+
+struct Search {
+    bool cave;
+    bool use[PREDICATES];
+    size_t cutOff;
+    int roomsBelow;
+    double floorMin, floorMax;
+    DungeonParams params;
+};
+
+struct Verdict {
+    int state[PREDICATES];
+
+    Verdict(const Search &s) {
+        for (int p = 0; p < PREDICATES; p++)
+            state[p] = s.use[p] ? UNKNOWN : YES;
+    }
+
+    int result() const {
+        int r = YES;
+        for (int p = 0; p < PREDICATES; p++) {
+            if (state[p] == NO)
+                return NO;
+            if (state[p] == UNKNOWN)
+                r = UNKNOWN;
+        }
+        return r;
+    }
+};
+
+static size_t openCells(const World &w) {
+    size_t cells = (size_t)w.getWidth() * w.getHeight(), open = 0;
+
+    for (size_t i = 0; i < cells; i++)
+        open += w.tiles()[i] != WALL;
+    return open;
+}
+
+static double floorRatio(const World &w) {
+    return (double)openCells(w) / ((size_t)w.getWidth() * w.getHeight());
+}
+
+static bool matchCave(World &w, const Search &s) {
+    Verdict v(s);
+    size_t open;
+    double ratio;
+
+    w.fillCave();
+    w.smoothCave();
+
+    //Cleanup only walls cells in, so too little floor now is too little after
+    open = openCells(w);
+    if (v.state[FLOOR_OUTSIDE] == UNKNOWN && (double)open / ((size_t)w.getWidth() * w.getHeight()) < s.floorMin)
+        v.state[FLOOR_OUTSIDE] = YES;
+    if (v.result() != UNKNOWN)
+        return v.result() == YES;
+
+    w.cleanCave();
+
+    if (v.state[DISCONNECTED] == UNKNOWN)
+        v.state[DISCONNECTED] = open - openCells(w) >= s.cutOff ? YES : NO;
+    if (v.state[FLOOR_OUTSIDE] == UNKNOWN) {
+        ratio = floorRatio(w);
+        v.state[FLOOR_OUTSIDE] = ratio < s.floorMin || ratio > s.floorMax ? YES : NO;
+    }
+    return v.result() == YES;
+}
+
+static bool matchDungeon(World &w, const Search &s) {
+    Verdict v(s);
+    double ratio;
+
+    w.placeRooms(s.params);
+
+    if (v.state[ROOMS_BELOW] == UNKNOWN)
+        v.state[ROOMS_BELOW] = (int)w.getRooms().size() < s.roomsBelow ? YES : NO;
+    if (v.state[STRANDED] == UNKNOWN && w.getRooms().size() < 2)
+        v.state[STRANDED] = NO;
+    if (v.result() != UNKNOWN)
+        return v.result() == YES;
+
+    w.compactRooms(s.params);
+    w.findHalls();
+
+    //Halls only carve, so too much floor now is too much after
+    if (v.state[FLOOR_OUTSIDE] == UNKNOWN && floorRatio(w) > s.floorMax)
+        v.state[FLOOR_OUTSIDE] = YES;
+    if (v.result() != UNKNOWN)
+        return v.result() == YES;
+
+    bool connected = w.selectHalls(s.params);
+
+    if (v.state[STRANDED] == UNKNOWN)
+        v.state[STRANDED] = connected ? NO : YES;
+    if (v.state[FLOOR_OUTSIDE] == UNKNOWN) {
+        ratio = floorRatio(w);
+        v.state[FLOOR_OUTSIDE] = ratio < s.floorMin || ratio > s.floorMax ? YES : NO;
+    }
+    return v.result() == YES;
+}
+
+static int usage() {
+    fprintf(stderr, "usage: thegame_seedsearch <first seed> <count> [--cave] [--stranded] [--disconnected n] [--rooms-below n] "
+            "[--floor-outside min max] [--size WxH] [--rooms n] [--kruskal] [--loops n] [--passes n] [--active] [--threads n] [--limit n]\n");
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    Search search;
+    uint64_t first, count, limit = 0;
+    int width = 100, height = 100, passes = DEFAULT_SMOOTH_PASSES;
+    unsigned threads = 0;
+    bool active = false, any = false;
+
+    if (argc < 4)
+        return usage();
+
+    first = strtoull(argv[1], NULL, 10);
+    count = strtoull(argv[2], NULL, 10);
+    search.cave = false;
+    search.cutOff = 0;
+    search.roomsBelow = 0;
+    search.floorMin = 0;
+    search.floorMax = 1;
+    for (int p = 0; p < PREDICATES; p++)
+        search.use[p] = false;
+
+    for (int i = 3; i < argc; i++) {
+        if (strcmp(argv[i], "--cave") == 0)
+            search.cave = true;
+        else if (strcmp(argv[i], "--stranded") == 0)
+            search.use[STRANDED] = true;
+        else if (strcmp(argv[i], "--disconnected") == 0 && i + 1 < argc) {
+            search.use[DISCONNECTED] = true;
+            search.cutOff = strtoull(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--rooms-below") == 0 && i + 1 < argc) {
+            search.use[ROOMS_BELOW] = true;
+            search.roomsBelow = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--floor-outside") == 0 && i + 2 < argc) {
+            search.use[FLOOR_OUTSIDE] = true;
+            search.floorMin = atof(argv[++i]);
+            search.floorMax = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc && sscanf(argv[i + 1], "%dx%d", &width, &height) == 2 && width >= MIN_MAP_SIZE && height >= MIN_MAP_SIZE)
+            i++;
+        else if (strcmp(argv[i], "--rooms") == 0 && i + 1 < argc && atoi(argv[i + 1]) >= 0)
+            search.params.numOfRooms = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--kruskal") == 0)
+            search.params.kruskal = true;
+        else if (strcmp(argv[i], "--loops") == 0 && i + 1 < argc)
+            search.params.extraLoops = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--passes") == 0 && i + 1 < argc)
+            passes = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--active") == 0)
+            active = true;
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            threads = (unsigned)atoi(argv[++i]);
+        else if (strcmp(argv[i], "--limit") == 0 && i + 1 < argc)
+            limit = strtoull(argv[++i], NULL, 10);
+        else
+            return usage();
+    }
+
+    //At least one predicate, and only ones that apply to what is built
+    for (int p = 0; p < PREDICATES; p++)
+        any = any || search.use[p];
+    if (!any || search.floorMin > search.floorMax)
+        return usage();
+    if (search.cave ? search.use[STRANDED] || search.use[ROOMS_BELOW] : search.use[DISCONNECTED])
+        return usage();
+
+    ThreadPool pool(threads);
+    std::vector<World> worlds(pool.size(), World(width, height));
+    std::vector<std::vector<uint64_t>> found(BLOCK_CHUNKS * pool.size());
+    std::vector<uint64_t> matches;
+    uint64_t scanned = 0, blockChunks = pool.size();
+
+    for (World &w : worlds)
+        w.setSmoothing(passes, active);
+
+    auto start = std::chrono::steady_clock::now();
+
+    while (scanned < count && (limit == 0 || matches.size() < limit)) {
+        uint64_t block = std::min(count - scanned, CHUNK * blockChunks);
+        uint64_t base = first + scanned;
+
+        pool.run((size_t)((block + CHUNK - 1) / CHUNK), [&](size_t c, unsigned thread) {
+            World &w = worlds[thread];
+            uint64_t end = std::min(block, (c + 1) * CHUNK);
+
+            for (uint64_t i = c * CHUNK; i < end; i++) {
+                w.seed(base + i);
+                if (search.cave ? matchCave(w, search) : matchDungeon(w, search))
+                    found[c].push_back(base + i);
+            }
+        });
+
+        //Each chunk's matches are in order, so chunk order keeps them sorted
+        for (std::vector<uint64_t> &f : found) {
+            matches.insert(matches.end(), f.begin(), f.end());
+            f.clear();
+        }
+        scanned += block;
+        blockChunks = std::min(blockChunks * 2, BLOCK_CHUNKS * pool.size());
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (limit > 0 && matches.size() > limit)
+        matches.resize(limit);
+    for (uint64_t seed : matches)
+        printf("%llu\n", (unsigned long long)seed);
+
+    fprintf(stderr, "scanned %llu seeds in %.3f s (%.0f seeds per second, %u threads), %zu matched\n",
+            (unsigned long long)scanned, seconds, seconds > 0 ? scanned / seconds : 0.0, pool.size(), matches.size());
+
+    return 0;
+}
@@ -0,0 +1,76 @@
+//
+//  tests.cpp
+//  GameProject
+//
+//  Created by Orin Elmquist on 6/12/18.
+//  Copyright © 2018 Orin Elmquist. All rights reserved.
+//
+
+#include <stdio.h>
+#include <vector>
+#include <algorithm>
+#include "World.hpp"
+#include "FieldOfView.hpp"
+
+/*
+ thegame_tests
+
+ Checks run by ctest. Each prints its failures on stderr, the first few in full, and the exit
+ status is 1 if any failed.
+
+     fovGrows - in the dungeons of seeds 1 .. FOV_SEEDS, from every open tile, whatever is visible
+                at one radius of FOV_RADII is still visible at the next
+ */
+
+const uint64_t FOV_SEEDS = 10;
+const int FOV_RADII[] = {1, 2, 3, 4, 6, 8, 12, 16, 24, 200};
+const int REPORTED = 5;
+
+static int fovGrows() {
+    World w(100, 100);
+    FieldOfView fov;
+    std::vector<size_t> seen;
+    int failures = 0;
+
+    for (uint64_t s = 1; s <= FOV_SEEDS; s++) {
+        w.seed(s);
+        w.buildDungeon();
+
+        for (int y = 0; y < w.getHeight(); y++)
+            for (int x = 0; x < w.getWidth(); x++) {
+                if (w.tiles()[(size_t)y * w.getWidth() + x] == WALL)
+                    continue;
+
+                seen.clear();
+                for (size_t r = 0; r < sizeof(FOV_RADII) / sizeof(FOV_RADII[0]); r++) {
+                    int radius = FOV_RADII[r];
+
+                    fov.compute(w, x, y, radius);
+                    for (size_t i : seen) {
+                        int tx = (int)(i % w.getWidth()), ty = (int)(i / w.getWidth());
+                        if (!fov.visible(tx, ty) && failures++ < REPORTED)
+                            fprintf(stderr, "fovGrows: seed %llu, viewer (%d, %d) sees (%d, %d) at radius %d but not %d\n",
+                                    (unsigned long long)s, x, y, tx, ty, FOV_RADII[r - 1], radius);
+                    }
+
+                    seen.clear();
+                    for (int ty = std::max(0, y - radius); ty <= std::min(w.getHeight() - 1, y + radius); ty++)
+                        for (int tx = std::max(0, x - radius); tx <= std::min(w.getWidth() - 1, x + radius); tx++)
+                            if (fov.visible(tx, ty))
+                                seen.push_back((size_t)ty * w.getWidth() + tx);
+                }
+            }
+    }
+
+    if (failures > 0)
+        fprintf(stderr, "fovGrows: %d tiles hidden by a larger radius\n", failures);
+    return failures;
+}
+
+int main() {
+    int failed = 0;
+
+    failed += fovGrows() > 0;
+
+    return failed > 0 ? 1 : 0;
+}